@@ -0,0 +1,620 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_cache.c
+//  Description    : This is the implementation of the client-side object
+//                   cache for the CRUD storage system.  Lines are found
+//                   through a hash of the object ID and replaced in least
+//                   recently used (LRU) order.  The object data lives in
+//                   buffers from the pool.  The interface functions are
+//                   serialized by a mutex.
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Project includes
+#include <crud_cache.h>
+#include <crud_pool.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_CACHE_NO_LINE -1
+#define CRUD_CACHE_UNIT_TEST_ITERATIONS 4096
+#define CRUD_CACHE_UNIT_TEST_OBJECTS 64
+#define CRUD_CACHE_UNIT_TEST_LINES 16
+
+// Type definitions
+
+// This is a single line of the cache (one object)
+typedef struct {
+	CrudOID   oid;    // The object held in the line (CRUD_NO_OBJECT if free)
+	uint32_t  length; // The length of the object data
+	char     *data;   // The object contents
+	int32_t   prev;   // The previous (more recently used) line
+	int32_t   next;   // The next (less recently used) line, or next free line
+	int32_t   hnext;  // The next line in the same hash bucket
+} CrudCacheLine;
+
+//
+// Module local data
+
+static uint32_t       cache_max_lines = CRUD_DEFAULT_CACHE_LINES; // Size of cache
+static CrudCacheLine *cache_lines = NULL;  // The cache lines
+static int32_t       *cache_buckets = NULL; // The hash buckets (line indices)
+static int32_t        cache_lru_head = CRUD_CACHE_NO_LINE; // Most recently used
+static int32_t        cache_lru_tail = CRUD_CACHE_NO_LINE; // Least recently used
+static int32_t        cache_free = CRUD_CACHE_NO_LINE;     // The free line list
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes the interface
+
+// Cache statistics
+static uint64_t cache_hits = 0;
+static uint64_t cache_misses = 0;
+static uint64_t cache_evictions = 0;
+static uint64_t cache_inserts = 0;
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_bucket
+// Description  : Compute the hash bucket for an object ID
+//
+// Inputs       : oid - the object ID
+// Outputs      : the bucket index
+
+static uint32_t cache_bucket(CrudOID oid) {
+	return((oid * 2654435761u) % cache_max_lines);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_find
+// Description  : Find the line holding an object
+//
+// Inputs       : oid - the object ID
+// Outputs      : the line index or CRUD_CACHE_NO_LINE if not present
+
+static int32_t cache_find(CrudOID oid) {
+
+	int32_t idx = cache_buckets[cache_bucket(oid)];
+	while ((idx != CRUD_CACHE_NO_LINE) && (cache_lines[idx].oid != oid)) {
+		idx = cache_lines[idx].hnext;
+	}
+	return(idx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_unlink
+// Description  : Remove a line from the LRU list and its hash bucket
+//
+// Inputs       : idx - the line index
+// Outputs      : none
+
+static void cache_unlink(int32_t idx) {
+
+	CrudCacheLine *line = &cache_lines[idx];
+	int32_t *walk;
+
+	// Pull out of the LRU list
+	if (line->prev != CRUD_CACHE_NO_LINE) {
+		cache_lines[line->prev].next = line->next;
+	} else {
+		cache_lru_head = line->next;
+	}
+	if (line->next != CRUD_CACHE_NO_LINE) {
+		cache_lines[line->next].prev = line->prev;
+	} else {
+		cache_lru_tail = line->prev;
+	}
+
+	// Pull out of the hash chain
+	walk = &cache_buckets[cache_bucket(line->oid)];
+	while (*walk != idx) {
+		walk = &cache_lines[*walk].hnext;
+	}
+	*walk = line->hnext;
+	line->prev = line->next = line->hnext = CRUD_CACHE_NO_LINE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_link
+// Description  : Insert a line at the head of the LRU list and into its
+//                hash bucket
+//
+// Inputs       : idx - the line index
+// Outputs      : none
+
+static void cache_link(int32_t idx) {
+
+	CrudCacheLine *line = &cache_lines[idx];
+	uint32_t bucket = cache_bucket(line->oid);
+
+	// Put at the head of the LRU list
+	line->prev = CRUD_CACHE_NO_LINE;
+	line->next = cache_lru_head;
+	if (cache_lru_head != CRUD_CACHE_NO_LINE) {
+		cache_lines[cache_lru_head].prev = idx;
+	} else {
+		cache_lru_tail = idx;
+	}
+	cache_lru_head = idx;
+
+	// Put in the hash chain
+	line->hnext = cache_buckets[bucket];
+	cache_buckets[bucket] = idx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_touch
+// Description  : Move a line to the head of the LRU list
+//
+// Inputs       : idx - the line index
+// Outputs      : none
+
+static void cache_touch(int32_t idx) {
+
+	CrudCacheLine *line = &cache_lines[idx];
+
+	// Already the most recent, nothing to do
+	if (cache_lru_head == idx) {
+		return;
+	}
+
+	// Unhook from the current place in the LRU list
+	cache_lines[line->prev].next = line->next;
+	if (line->next != CRUD_CACHE_NO_LINE) {
+		cache_lines[line->next].prev = line->prev;
+	} else {
+		cache_lru_tail = line->prev;
+	}
+
+	// Now place at the head
+	line->prev = CRUD_CACHE_NO_LINE;
+	line->next = cache_lru_head;
+	cache_lines[cache_lru_head].prev = idx;
+	cache_lru_head = idx;
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_remove
+// Description  : Drop the object in a line and return it to the free list
+//
+// Inputs       : idx - the line index
+// Outputs      : none
+
+static void cache_remove(int32_t idx) {
+
+	cache_unlink(idx);
+	free_crud_pool(cache_lines[idx].data);
+	cache_lines[idx].data = NULL;
+	cache_lines[idx].length = 0;
+	cache_lines[idx].oid = CRUD_NO_OBJECT;
+	cache_lines[idx].next = cache_free;
+	cache_free = idx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_claim
+// Description  : Find the line for an object, or take a free one, or evict
+//                the LRU line for it; the line ends up most recently used
+//
+// Inputs       : oid - the object ID
+// Outputs      : the line index
+
+static int32_t cache_claim(CrudOID oid) {
+
+	int32_t idx;
+
+	if ((idx = cache_find(oid)) != CRUD_CACHE_NO_LINE) {
+		cache_touch(idx);
+	} else {
+		if (cache_free != CRUD_CACHE_NO_LINE) {
+			idx = cache_free;
+			cache_free = cache_lines[idx].next;
+		} else {
+			idx = cache_lru_tail;
+			logMessage(LOG_INFO_LEVEL, "CRUD cache : evicting object %u", cache_lines[idx].oid);
+			cache_unlink(idx);
+			cache_evictions++;
+		}
+		cache_lines[idx].oid = oid;
+		cache_link(idx);
+	}
+	cache_inserts++;
+	return(idx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : set_crud_cache_size
+// Description  : Set the size of the cache (must be called before init)
+//
+// Inputs       : max_lines - the maximum number of objects to hold
+// Outputs      : 0 if successful, -1 if failure
+
+int set_crud_cache_size(uint32_t max_lines) {
+
+	// Can't resize a live cache, and need at least one line
+	if ((cache_lines != NULL) || (max_lines == 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD cache : bad cache size [%u]", max_lines);
+		return(-1);
+	}
+	cache_max_lines = max_lines;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : init_crud_cache
+// Description  : Initialize the cache (no-op if already initialized)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int init_crud_cache(void) {
+
+	uint32_t i;
+
+	// Already setup, just return
+	pthread_mutex_lock(&cache_lock);
+	if (cache_lines != NULL) {
+		pthread_mutex_unlock(&cache_lock);
+		return(0);
+	}
+
+	// Allocate the lines and buckets
+	cache_lines = malloc(sizeof(CrudCacheLine) * cache_max_lines);
+	cache_buckets = malloc(sizeof(int32_t) * cache_max_lines);
+	if ((cache_lines == NULL) || (cache_buckets == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD cache : allocation of %u lines failed", cache_max_lines);
+		free(cache_lines);
+		free(cache_buckets);
+		cache_lines = NULL;
+		cache_buckets = NULL;
+		pthread_mutex_unlock(&cache_lock);
+		return(-1);
+	}
+
+	// Put every line on the free list
+	for (i=0; i<cache_max_lines; i++) {
+		cache_lines[i].oid = CRUD_NO_OBJECT;
+		cache_lines[i].length = 0;
+		cache_lines[i].data = NULL;
+		cache_lines[i].prev = CRUD_CACHE_NO_LINE;
+		cache_lines[i].next = (i+1 < cache_max_lines) ? (int32_t)i+1 : CRUD_CACHE_NO_LINE;
+		cache_lines[i].hnext = CRUD_CACHE_NO_LINE;
+		cache_buckets[i] = CRUD_CACHE_NO_LINE;
+	}
+	cache_free = 0;
+	cache_lru_head = cache_lru_tail = CRUD_CACHE_NO_LINE;
+
+	// Reset the statistics
+	cache_hits = cache_misses = cache_evictions = cache_inserts = 0;
+
+	// Log, return successfully
+	pthread_mutex_unlock(&cache_lock);
+	logMessage(LOG_INFO_LEVEL, "CRUD cache : initialized with %u lines", cache_max_lines);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : close_crud_cache
+// Description  : Clear all of the contents of the cache, log the statistics
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int close_crud_cache(void) {
+
+	uint32_t i;
+	uint64_t lookups;
+
+	// Not open, nothing to do
+	pthread_mutex_lock(&cache_lock);
+	if (cache_lines == NULL) {
+		pthread_mutex_unlock(&cache_lock);
+		return(0);
+	}
+	lookups = cache_hits + cache_misses;
+
+	// Report the statistics for the session
+	logMessage(LOG_OUTPUT_LEVEL, "CRUD cache : %lu hits, %lu misses, %lu evictions, %lu inserts (%.2f%% hit ratio)",
+			cache_hits, cache_misses, cache_evictions, cache_inserts,
+			(lookups) ? (double)cache_hits*100.0/lookups : 0.0);
+
+	// Free the object data and the line structures
+	for (i=0; i<cache_max_lines; i++) {
+		free_crud_pool(cache_lines[i].data);
+	}
+	free(cache_lines);
+	free(cache_buckets);
+	cache_lines = NULL;
+	cache_buckets = NULL;
+	cache_lru_head = cache_lru_tail = cache_free = CRUD_CACHE_NO_LINE;
+
+	// Return successfully
+	pthread_mutex_unlock(&cache_lock);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : put_crud_cache
+// Description  : Put an object into the cache, evicting the least recently
+//                used object if the cache is full
+//
+// Inputs       : oid - the object ID
+//                buf - the object contents (copied into the cache)
+//                length - the length of the object
+// Outputs      : pointer to the cached copy of the object or NULL if failure
+
+void * put_crud_cache(CrudOID oid, void *buf, uint32_t length) {
+
+	int32_t idx;
+	char *data;
+
+	// Sanity check the parameters
+	pthread_mutex_lock(&cache_lock);
+	if ((cache_lines == NULL) || (oid == CRUD_NO_OBJECT)) {
+		pthread_mutex_unlock(&cache_lock);
+		return(NULL);
+	}
+	idx = cache_claim(oid);
+
+	// Swap in a bigger pool buffer as needed, then copy in the contents
+	data = cache_lines[idx].data;
+	if ((data == NULL) || (size_crud_pool(data) < length)) {
+		if ((data = alloc_crud_pool(length)) == NULL) {
+			cache_remove(idx);
+			pthread_mutex_unlock(&cache_lock);
+			return(NULL);
+		}
+	}
+	if (buf != data) {
+		memcpy(data, buf, length);
+	}
+	if (data != cache_lines[idx].data) {
+		free_crud_pool(cache_lines[idx].data);
+		cache_lines[idx].data = data;
+	}
+	cache_lines[idx].length = length;
+
+	// Return the cached copy
+	data = cache_lines[idx].data;
+	pthread_mutex_unlock(&cache_lock);
+	return(data);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : adopt_crud_cache
+// Description  : Put an object into the cache by taking over the caller's
+//                buffer (no copy), evicting the least recently used object
+//                if the cache is full
+//
+// Inputs       : oid - the object ID
+//                buf - the object contents (from the pool, now owned by the cache)
+//                length - the length of the object
+// Outputs      : pointer to the cached copy of the object or NULL if failure
+//                (the buffer is freed)
+
+void * adopt_crud_cache(CrudOID oid, void *buf, uint32_t length) {
+
+	int32_t idx;
+
+	// Sanity check the parameters
+	pthread_mutex_lock(&cache_lock);
+	if ((cache_lines == NULL) || (oid == CRUD_NO_OBJECT)) {
+		pthread_mutex_unlock(&cache_lock);
+		free_crud_pool(buf);
+		return(NULL);
+	}
+	idx = cache_claim(oid);
+
+	// Swap the buffer in for the old contents of the line
+	if (cache_lines[idx].data != buf) {
+		free_crud_pool(cache_lines[idx].data);
+	}
+	cache_lines[idx].data = buf;
+	cache_lines[idx].length = length;
+	pthread_mutex_unlock(&cache_lock);
+	return(buf);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_crud_cache
+// Description  : Get an object from the cache.  The returned buffer belongs
+//                to the cache and is valid until the next put/delete/close;
+//                callers may modify it in place to keep it current.
+//
+// Inputs       : oid - the object ID
+//                length - place to put the length of the object
+// Outputs      : pointer to the object contents or NULL if not found
+
+void * get_crud_cache(CrudOID oid, uint32_t *length) {
+
+	int32_t idx;
+	char *data;
+
+	// Look up the object, count the result
+	pthread_mutex_lock(&cache_lock);
+	if ((cache_lines == NULL) || (oid == CRUD_NO_OBJECT)) {
+		pthread_mutex_unlock(&cache_lock);
+		return(NULL);
+	}
+	if ((idx = cache_find(oid)) == CRUD_CACHE_NO_LINE) {
+		cache_misses++;
+		pthread_mutex_unlock(&cache_lock);
+		return(NULL);
+	}
+	cache_hits++;
+
+	// Mark as most recently used, return the contents
+	cache_touch(idx);
+	*length = cache_lines[idx].length;
+	data = cache_lines[idx].data;
+	pthread_mutex_unlock(&cache_lock);
+	return(data);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : copy_crud_cache
+// Description  : Copy part of an object out of the cache (safe while other
+//                threads put objects, unlike using the get_crud_cache buffer)
+//
+// Inputs       : oid - the object ID
+//                offset - the first byte to copy
+//                count - the number of bytes to copy
+//                buf - the buffer to copy into
+// Outputs      : 0 if successful, -1 if not found (or too short)
+
+int copy_crud_cache(CrudOID oid, uint32_t offset, uint32_t count, void *buf) {
+
+	int32_t idx;
+
+	// Look up the object, count the result
+	pthread_mutex_lock(&cache_lock);
+	if ((cache_lines == NULL) || (oid == CRUD_NO_OBJECT)) {
+		pthread_mutex_unlock(&cache_lock);
+		return(-1);
+	}
+	if (((idx = cache_find(oid)) == CRUD_CACHE_NO_LINE) || (offset + count > cache_lines[idx].length)) {
+		cache_misses++;
+		pthread_mutex_unlock(&cache_lock);
+		return(-1);
+	}
+	cache_hits++;
+
+	// Mark as most recently used, copy the bytes out
+	cache_touch(idx);
+	memcpy(buf, &cache_lines[idx].data[offset], count);
+	pthread_mutex_unlock(&cache_lock);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delete_crud_cache
+// Description  : Remove an object from the cache
+//
+// Inputs       : oid - the object ID
+// Outputs      : 0 if successful, -1 if not found
+
+int delete_crud_cache(CrudOID oid) {
+
+	int32_t idx;
+
+	// Find the line, return it to the free list
+	pthread_mutex_lock(&cache_lock);
+	if ((cache_lines == NULL) || ((idx = cache_find(oid)) == CRUD_CACHE_NO_LINE)) {
+		pthread_mutex_unlock(&cache_lock);
+		return(-1);
+	}
+	cache_remove(idx);
+	pthread_mutex_unlock(&cache_lock);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudCacheUnitTest
+// Description  : Perform a test of the cache implementation against a
+//                simple model that tracks the recency of each object
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crudCacheUnitTest(void) {
+
+	// Local variables
+	uint32_t stamp[CRUD_CACHE_UNIT_TEST_OBJECTS+1], saved_size = cache_max_lines;
+	uint32_t clock = 0, live, oldest, length, i, j;
+	char block[CRUD_CACHE_UNIT_TEST_OBJECTS+1], *data;
+	CrudOID oid;
+
+	// Setup a small cache so we exercise eviction
+	close_crud_cache();
+	if (set_crud_cache_size(CRUD_CACHE_UNIT_TEST_LINES) || init_crud_cache()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_CACHE_UNIT_TEST : init failed.");
+		return(-1);
+	}
+	memset(stamp, 0x0, sizeof(stamp));
+
+	for (i=0; i<CRUD_CACHE_UNIT_TEST_ITERATIONS; i++) {
+
+		// Pick an object, object N is N bytes of the value N
+		oid = getRandomValue(1, CRUD_CACHE_UNIT_TEST_OBJECTS);
+		data = get_crud_cache(oid, &length);
+
+		// The object should be present iff the model says it is cached
+		if (stamp[oid] != 0) {
+			if ((data == NULL) || (length != oid) || (data[0] != (char)oid) ||
+					(memcmp(data, data+1, length-1)) || copy_crud_cache(oid, length-1, 1, block) ||
+					(block[0] != (char)oid) || (copy_crud_cache(oid, length, 1, block) == 0)) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_CACHE_UNIT_TEST : bad/missing object %u.", oid);
+				return(-1);
+			}
+		} else if (data != NULL) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_CACHE_UNIT_TEST : object %u not evicted.", oid);
+			return(-1);
+		}
+
+		// On a miss, put it in (model evicts the least recently used if full)
+		if (data == NULL) {
+			for (j=1, live=0, oldest=0; j<=CRUD_CACHE_UNIT_TEST_OBJECTS; j++) {
+				if (stamp[j] != 0) {
+					live++;
+					if ((oldest == 0) || (stamp[j] < stamp[oldest])) {
+						oldest = j;
+					}
+				}
+			}
+			if (live == CRUD_CACHE_UNIT_TEST_LINES) {
+				stamp[oldest] = 0;
+			}
+			memset(block, oid, oid);
+			if (getRandomValue(0, 1)) {
+				data = alloc_crud_pool(oid);
+				memset(data, oid, oid);
+				data = adopt_crud_cache(oid, data, oid);
+			} else {
+				data = put_crud_cache(oid, block, oid);
+			}
+			if (data == NULL) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_CACHE_UNIT_TEST : put failed.");
+				return(-1);
+			}
+			stamp[oid] = ++clock;
+
+		// On a hit, randomly delete it
+		} else if (getRandomValue(0, 7) == 0) {
+			delete_crud_cache(oid);
+			stamp[oid] = 0;
+		} else {
+			stamp[oid] = ++clock;
+		}
+	}
+
+	// Cleanup, restore the configured size
+	close_crud_cache();
+	set_crud_cache_size(saved_size);
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "CRUD cache unit test completed successfully.");
+	return(0);
+}
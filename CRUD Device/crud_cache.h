@@ -0,0 +1,54 @@
+#ifndef CRUD_CACHE_INCLUDED
+#define CRUD_CACHE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_cache.h
+//  Description    : This is the interface for the client-side object cache
+//                   of the CRUD storage system.  Each cache line holds the
+//                   full contents of one object, replaced in LRU order.
+//
+
+// Includes
+#include <stdint.h>
+
+// Project includes
+#include <crud_driver.h>
+
+// Defines
+#define CRUD_DEFAULT_CACHE_LINES 1024
+
+//
+// Cache interface
+
+int set_crud_cache_size(uint32_t max_lines);
+	// Set the size of the cache (must be called before init)
+
+int init_crud_cache(void);
+	// Initialize the cache (no-op if already initialized)
+
+int close_crud_cache(void);
+	// Clear all of the contents of the cache, log the statistics
+
+void * put_crud_cache(CrudOID oid, void *buf, uint32_t length);
+	// Put an object into the cache (copies the buffer), returns the cached copy
+
+void * adopt_crud_cache(CrudOID oid, void *buf, uint32_t length);
+	// Put an object into the cache (takes over the pool buffer), returns the cached copy
+
+void * get_crud_cache(CrudOID oid, uint32_t *length);
+	// Get an object from the cache (returns NULL if not found)
+
+int copy_crud_cache(CrudOID oid, uint32_t offset, uint32_t count, void *buf);
+	// Copy part of an object out of the cache (returns -1 if not found)
+
+int delete_crud_cache(CrudOID oid);
+	// Remove an object from the cache
+
+//
+// Unit testing for the module
+
+int crudCacheUnitTest(void);
+	// Perform a test of the cache implementation
+
+#endif
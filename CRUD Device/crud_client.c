@@ -18,6 +18,8 @@
 int            crud_network_shutdown = 0; // Flag indicating shutdown
 unsigned char *crud_network_address = NULL; // Address of CRUD server 
 unsigned short crud_network_port = 0; // Port of CRUD server
+int            crud_network_extensions = 0; // Server supports ranged requests
+int            crud_network_test_server = 0; // Use the in-process test server instead
 
 //
 // Functions
@@ -43,6 +45,9 @@ unsigned short crud_network_port = 0; // Port of CRUD server
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <pthread.h>
 
 // Global variables
 //int            crud_network_shutdown = 0; // Flag indicating shutdown
@@ -50,11 +55,31 @@ unsigned short crud_network_port = 0; // Port of CRUD server
 //unsigned short crud_network_port = 0; // Port of CRUD server
 int            socket_fd = -1; // socket file descriptor
 
+// Requests sent ahead of their responses (responses arrive in request order)
+typedef enum {
+    CRUD_PENDING_FREE   = 0, // Slot unused
+    CRUD_PENDING_POSTED = 1, // Request sent, response not yet received
+    CRUD_PENDING_DONE   = 2, // Response received, not yet collected
+} CRUD_PENDING_STATE;
+
+typedef struct {
+    CRUD_PENDING_STATE state;    // State of the slot
+    uint8_t            request;  // Request type (reads get a payload back)
+    uint32_t           sequence; // Order the request was sent in
+    void              *buf;      // Where the response payload goes
+    CrudResponse       response; // The response, once received
+} CrudPendingRequest;
+
+CrudPendingRequest crud_pending[CRUD_MAX_PENDING_REQUESTS]; // The posted requests
+uint32_t           crud_pending_sequence = 0; // Sequence number of the next post
+pthread_mutex_t    crud_connection_lock = PTHREAD_MUTEX_INITIALIZER; // One request/response exchange at a time
+
 //
 // Functions
 
-int crud_send(CrudRequest request, void *buf);
+int crud_send(CrudRequest request, uint32_t offset, void *buf);
 CrudResponse crud_receive(void *buf);
+int crud_receive_next(void);
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -71,21 +96,50 @@ CrudResponse crud_receive(void *buf);
 // Outputs      : the response structure encoded as needed
 
 CrudResponse crud_client_operation(CrudRequest op, void *buf) {
+    return crud_client_range_operation(op, 0, buf);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_range_operation
+// Description  : This the client operation for requests that carry a range
+//                extension word (see crud_driver.h); the offset is ignored
+//                for all other requests.
+//
+// Inputs       : op - the request opcode for the command
+//                offset - the byte offset into the object
+//                buf - the block to be read/written from (READ/WRITE)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_client_range_operation(CrudRequest op, uint32_t offset, void *buf) {
     // Declare variables
     CrudResponse response;
     uint8_t request;
 
     // get the request type
     request = (op >> 28) & 0xf;
+    pthread_mutex_lock(&crud_connection_lock);
+
+    // if CRUD_INIT with the test server, it serves the other end of a socket pair
+    if (request == CRUD_INIT && crud_network_test_server)
+    {
+        if ((socket_fd = crud_test_server_connect()) == -1)
+        {
+            printf("Error connecting to test server\n");
+            pthread_mutex_unlock(&crud_connection_lock);
+            return(-1);
+        }
+    }
 
     // if CRUD_INIT then make a connection to the server 
-    if (request == CRUD_INIT)
+    else if (request == CRUD_INIT)
     {
         // Create socket
         socket_fd = socket(PF_INET, SOCK_STREAM, 0);
         if (socket_fd == -1)
         {
             printf("Error on socket creation\n");
+            pthread_mutex_unlock(&crud_connection_lock);
             return(-1);
         }
 
@@ -95,6 +149,7 @@ CrudResponse crud_client_operation(CrudRequest op, void *buf) {
         caddr.sin_port = htons(CRUD_DEFAULT_PORT);
         if (inet_aton(CRUD_DEFAULT_IP, &caddr.sin_addr) == 0)
         {
+            pthread_mutex_unlock(&crud_connection_lock);
             return(-1);
         }
 
@@ -103,13 +158,20 @@ CrudResponse crud_client_operation(CrudRequest op, void *buf) {
                     sizeof(struct sockaddr)) == -1)
         {
             printf("Error connecting to server\n");
+            pthread_mutex_unlock(&crud_connection_lock);
             return(-1);
         }
     }
 
+    // Collect the responses of posted requests, they come back first
+    while (crud_receive_next() == 0);
+
     // Send request to server
-    if (crud_send(op, buf) != 0)
+    if (crud_send(op, offset, buf) != 0)
+    {
+        pthread_mutex_unlock(&crud_connection_lock);
         return -1;
+    }
 
     // Receive response
     response = crud_receive(buf);
@@ -121,11 +183,191 @@ CrudResponse crud_client_operation(CrudRequest op, void *buf) {
         socket_fd = -1;
     }
 
+    pthread_mutex_unlock(&crud_connection_lock);
     return response;
 	
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_post
+// Description  : This sends a request to the server without waiting for the
+//                response, so several requests can be in flight at once.
+//                The response is collected with crud_client_complete (any
+//                other operation first receives the responses still owed).
+//
+// Inputs       : op - the request opcode for the command (not INIT/CLOSE)
+//                offset - the byte offset into the object (ranged requests)
+//                buf - the block to be read/written from (READ/WRITE), must
+//                      stay valid until the request is completed
+// Outputs      : a ticket for the request, -1 if it could not be posted
+
+int crud_client_post(CrudRequest op, uint32_t offset, void *buf) {
+    // Declare variables
+    uint8_t request = (op >> 28) & 0xf;
+    int ticket;
+
+    pthread_mutex_lock(&crud_connection_lock);
+
+    // Only requests on an open connection, and only while there is room
+    if ((socket_fd == -1) || (request == CRUD_INIT) || (request == CRUD_CLOSE))
+    {
+        pthread_mutex_unlock(&crud_connection_lock);
+        return -1;
+    }
+    for (ticket = 0; ticket < CRUD_MAX_PENDING_REQUESTS; ticket++)
+    {
+        if (crud_pending[ticket].state == CRUD_PENDING_FREE)
+            break;
+    }
+    if (ticket == CRUD_MAX_PENDING_REQUESTS)
+    {
+        pthread_mutex_unlock(&crud_connection_lock);
+        return -1;
+    }
+
+    // A request carrying a payload waits for the posted reads to come back,
+    // the server could otherwise block sending them while we block sending
+    if (request == CRUD_CREATE || request == CRUD_UPDATE || request == CRUD_UPDATE_RANGE || request == CRUD_APPEND)
+    {
+        for (int i = 0; i < CRUD_MAX_PENDING_REQUESTS; i++)
+        {
+            if ((crud_pending[i].state == CRUD_PENDING_POSTED) &&
+                    (crud_pending[i].request == CRUD_READ || crud_pending[i].request == CRUD_READ_RANGE))
+            {
+                if (crud_receive_next() != 0)
+                {
+                    pthread_mutex_unlock(&crud_connection_lock);
+                    return -1;
+                }
+                i = -1;
+            }
+        }
+    }
+
+    // Send request to server, remember where its response goes
+    if (crud_send(op, offset, buf) != 0)
+    {
+        pthread_mutex_unlock(&crud_connection_lock);
+        return -1;
+    }
+    crud_pending[ticket].state = CRUD_PENDING_POSTED;
+    crud_pending[ticket].request = request;
+    crud_pending[ticket].sequence = crud_pending_sequence++;
+    crud_pending[ticket].buf = buf;
+    pthread_mutex_unlock(&crud_connection_lock);
+    return ticket;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_complete
+// Description  : This waits for the response to a posted request (receiving
+//                the responses to any requests posted before it).
+//
+// Inputs       : ticket - the ticket returned by crud_client_post
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_client_complete(int ticket) {
+    // Declare variables
+    CrudResponse response;
+
+    pthread_mutex_lock(&crud_connection_lock);
+
+    if ((ticket < 0) || (ticket >= CRUD_MAX_PENDING_REQUESTS) ||
+            (crud_pending[ticket].state == CRUD_PENDING_FREE))
+    {
+        pthread_mutex_unlock(&crud_connection_lock);
+        return -1;
+    }
+
+    // Receive in order until this one is in
+    while (crud_pending[ticket].state == CRUD_PENDING_POSTED)
+    {
+        if (crud_receive_next() != 0)
+        {
+            pthread_mutex_unlock(&crud_connection_lock);
+            return -1;
+        }
+    }
+
+    response = crud_pending[ticket].response;
+    crud_pending[ticket].state = CRUD_PENDING_FREE;
+    pthread_mutex_unlock(&crud_connection_lock);
+    return response;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_poll
+// Description  : This checks if the response to a posted request is in,
+//                receiving the responses that arrived without blocking.
+//
+// Inputs       : ticket - the ticket returned by crud_client_post
+// Outputs      : 1 if the response is in, 0 if not yet, -1 if bad ticket
+
+int crud_client_poll(int ticket) {
+    // Declare variables
+    fd_set readable;
+    struct timeval now = {0, 0};
+
+    pthread_mutex_lock(&crud_connection_lock);
+
+    if ((ticket < 0) || (ticket >= CRUD_MAX_PENDING_REQUESTS) ||
+            (crud_pending[ticket].state == CRUD_PENDING_FREE))
+    {
+        pthread_mutex_unlock(&crud_connection_lock);
+        return -1;
+    }
+
+    // Take in responses for as long as there is something to read
+    while (crud_pending[ticket].state == CRUD_PENDING_POSTED)
+    {
+        FD_ZERO(&readable);
+        FD_SET(socket_fd, &readable);
+        if (select(socket_fd + 1, &readable, NULL, NULL, &now) <= 0)
+        {
+            pthread_mutex_unlock(&crud_connection_lock);
+            return 0;
+        }
+        if (crud_receive_next() != 0)
+        {
+            pthread_mutex_unlock(&crud_connection_lock);
+            return -1;
+        }
+    }
+    pthread_mutex_unlock(&crud_connection_lock);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_receive_next
+// Description  : This receives the response to the oldest posted request.
+//
+// Inputs       : none
+// Outputs      : 0 if a response was received, -1 if nothing is posted
+
+int crud_receive_next(void)
+{
+    // Declare variables
+    int i, oldest = -1;
+
+    for (i = 0; i < CRUD_MAX_PENDING_REQUESTS; i++)
+    {
+        if ((crud_pending[i].state == CRUD_PENDING_POSTED) && ((oldest == -1) ||
+                (crud_pending[i].sequence - crud_pending[oldest].sequence > 0x7fffffff)))
+            oldest = i;
+    }
+    if (oldest == -1)
+        return -1;
+
+    crud_pending[oldest].response = crud_receive(crud_pending[oldest].buf);
+    crud_pending[oldest].state = CRUD_PENDING_DONE;
+    return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : crud_send
@@ -133,38 +375,57 @@ CrudResponse crud_client_operation(CrudRequest op, void *buf) {
 //                  server (and buffer if necessary).
 //
 // Inputs       : request - the request opcode for the command
+//                offset - the byte offset (ranged requests only)
 //                buf - the block to be read/written from (READ/WRITE)
 // Outputs      : 0 if successful, -1 if error 
 
-int crud_send(CrudRequest request, void *buf)
+int crud_send(CrudRequest request, uint32_t offset, void *buf)
 {
     // Declare variables
-    int requestLen = sizeof(CrudRequest);
-    int reqAmtWritten;
-    CrudRequest *requestOrder = malloc(requestLen);
+    CrudRequest requestOrder[2];
+    struct iovec parts[2];
     int req = (request >> 28) & 0xf;
     int bufLength = (request >> 4) & 0xffffff;
-    int bufAmtWritten;
+    int count = 1;
+    ssize_t written;
 
     // Convert request value to network byte order 
-    *requestOrder = htonll64(request);
+    requestOrder[0] = htonll64(request);
+    parts[0].iov_base = requestOrder;
+    parts[0].iov_len = sizeof(CrudRequest);
 
-    // Send converted request value, make sure all bytes are sent
-    reqAmtWritten = write(socket_fd, requestOrder, requestLen); 
-    while (reqAmtWritten < requestLen)
+    // Ranged requests carry the range extension word right after the header
+    if (crud_request_is_ranged(req))
     {
-        reqAmtWritten += write(socket_fd, (char *)requestOrder+reqAmtWritten,
-                requestLen - reqAmtWritten);
+        requestOrder[1] = htonll64(construct_crud_range(offset));
+        parts[0].iov_len += sizeof(CrudRange);
     }
-    free(requestOrder);
 
     // Check if you need to send buffer as well
-    if (req == CRUD_CREATE || req == CRUD_UPDATE)
+    if (req == CRUD_CREATE || req == CRUD_UPDATE || req == CRUD_UPDATE_RANGE || req == CRUD_APPEND)
     {
-        bufAmtWritten = write(socket_fd, buf, bufLength);
-        while (bufAmtWritten < bufLength)
+        parts[1].iov_base = buf;
+        parts[1].iov_len = bufLength;
+        count = 2;
+    }
+
+    // Send the header and payload in one write (so they don't go out as
+    // separate segments), make sure all bytes are sent
+    while (count > 0)
+    {
+        written = writev(socket_fd, parts, count);
+        if (written < 0)
+            return -1;
+        while (count > 0 && (size_t)written >= parts[0].iov_len)
         {
-            bufAmtWritten += write(socket_fd, ((char *)buf)+bufAmtWritten, bufLength - bufAmtWritten);
+            written -= parts[0].iov_len;
+            parts[0] = parts[1];
+            count--;
+        }
+        if (count > 0)
+        {
+            parts[0].iov_base = (char *)parts[0].iov_base + written;
+            parts[0].iov_len -= written;
         }
     }
 
@@ -187,28 +448,27 @@ CrudResponse crud_receive(void *buf)
     CrudResponse responseOrder;
     int reponseLen = sizeof(CrudResponse);
     int responseAmtRead;
-    CrudResponse *response = malloc(reponseLen);
+    CrudResponse response;
     int bufLen;
     int bufAmtRead;
     int responseRequest;
 
     // Receive response value
-    responseAmtRead = read(socket_fd, response, reponseLen);
+    responseAmtRead = read(socket_fd, &response, reponseLen);
     while (responseAmtRead < reponseLen)
     {
-        responseAmtRead += read(socket_fd, (char *)response +responseAmtRead, reponseLen - responseAmtRead);
+        responseAmtRead += read(socket_fd, (char *)&response +responseAmtRead, reponseLen - responseAmtRead);
     }
 
     // Convert received value into host byte order
-    responseOrder = ntohll64(*response);
-    free(response);
+    responseOrder = ntohll64(response);
 
     // Extract request type and length from converted response
     responseRequest = (responseOrder >> 28) & 0xf;
     bufLen = (responseOrder >> 4) & 0xffffff;
 
     // Check if you need to receive buffer
-    if (responseRequest == CRUD_READ)
+    if (responseRequest == CRUD_READ || responseRequest == CRUD_READ_RANGE)
     {
         bufAmtRead = read(socket_fd, buf, bufLen);
         while (bufAmtRead < bufLen)
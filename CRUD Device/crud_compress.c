@@ -0,0 +1,327 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_compress.c
+//  Description    : This is the implementation of the block compressor of the
+//                   CRUD client.  The compressed block is a list of sequences,
+//                   each a token byte (literal count in the high nibble, match
+//                   length - 4 in the low nibble, 15 meaning more length bytes
+//                   follow), the literals, then a two byte little endian offset
+//                   back to the match.  The last sequence is literals only.
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+
+// Project includes
+#include <crud_compress.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_COMPRESS_HASH_BITS 12     // Size of the match finder table (log 2)
+#define CRUD_COMPRESS_MIN_MATCH 4      // Shortest back reference
+#define CRUD_COMPRESS_MAX_OFFSET 65535 // Furthest back reference
+#define CRUD_COMPRESS_LAST_LITERALS 5  // Bytes at the end always sent as literals
+#define CRUD_COMPRESS_MATCH_LIMIT 12   // No match starts this close to the end
+#define CRUD_COMPRESS_UNIT_TEST_SIZE 100000
+#define CRUD_COMPRESS_UNIT_TEST_ITERATIONS 64
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_hash
+// Description  : Hash the four bytes at a position for the match finder
+//
+// Inputs       : p - the bytes
+// Outputs      : the table index
+
+static uint32_t compress_hash(const uint8_t *p) {
+
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return((v * 2654435761u) >> (32 - CRUD_COMPRESS_HASH_BITS));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_length
+// Description  : Write the bytes extending a length that did not fit its nibble
+//
+// Inputs       : dst - the output, pos - where to write (updated)
+//                capacity - size of the output, length - what is left over
+// Outputs      : 0 if successful, -1 if the output is full
+
+static int compress_length(uint8_t *dst, uint32_t *pos, uint32_t capacity, uint32_t length) {
+
+	while (length >= 255) {
+		if (*pos >= capacity) {
+			return(-1);
+		}
+		dst[(*pos)++] = 255;
+		length -= 255;
+	}
+	if (*pos >= capacity) {
+		return(-1);
+	}
+	dst[(*pos)++] = (uint8_t)length;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_sequence
+// Description  : Write one sequence: the literals, then the match (if any)
+//
+// Inputs       : dst - the output, pos - where to write (updated)
+//                capacity - size of the output, lit - the literals
+//                litLength - number of literals, offset - back reference
+//                match - match length (0 for the last sequence)
+// Outputs      : 0 if successful, -1 if the output is full
+
+static int compress_sequence(uint8_t *dst, uint32_t *pos, uint32_t capacity, const uint8_t *lit,
+		uint32_t litLength, uint32_t offset, uint32_t match) {
+
+	uint32_t ml = (match) ? match - CRUD_COMPRESS_MIN_MATCH : 0;
+	uint8_t *token;
+
+	// The token, then the literals
+	if (*pos >= capacity) {
+		return(-1);
+	}
+	token = &dst[(*pos)++];
+	*token = (uint8_t)(((litLength < 15) ? litLength : 15) << 4);
+	if ((litLength >= 15) && (compress_length(dst, pos, capacity, litLength - 15) != 0)) {
+		return(-1);
+	}
+	if (capacity - *pos < litLength) {
+		return(-1);
+	}
+	memcpy(&dst[*pos], lit, litLength);
+	*pos += litLength;
+
+	// The back reference
+	if (match) {
+		*token |= (uint8_t)((ml < 15) ? ml : 15);
+		if (capacity - *pos < 2) {
+			return(-1);
+		}
+		dst[(*pos)++] = (uint8_t)(offset & 0xff);
+		dst[(*pos)++] = (uint8_t)(offset >> 8);
+		if ((ml >= 15) && (compress_length(dst, pos, capacity, ml - 15) != 0)) {
+			return(-1);
+		}
+	}
+	return(0);
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_crud_buffer
+// Description  : Compress a buffer, matches are found through a table of the
+//                last position each four byte hash was seen at
+//
+// Inputs       : src - the data, length - number of bytes
+//                dst - the output, capacity - size of the output
+// Outputs      : the compressed size, -1 if it does not fit in capacity
+
+int32_t compress_crud_buffer(const void *src, uint32_t length, void *dst, uint32_t capacity) {
+
+	const uint8_t *in = src;
+	uint32_t table[1 << CRUD_COMPRESS_HASH_BITS];
+	uint32_t ip = 0, anchor = 0, pos = 0, limit, candidate, match, h;
+
+	// Look for matches until close to the end
+	memset(table, 0x0, sizeof(table));
+	limit = (length > CRUD_COMPRESS_MATCH_LIMIT) ? length - CRUD_COMPRESS_MATCH_LIMIT : 0;
+	while (ip < limit) {
+		h = compress_hash(&in[ip]);
+		candidate = table[h];
+		table[h] = ip;
+		if ((candidate >= ip) || (ip - candidate > CRUD_COMPRESS_MAX_OFFSET) ||
+				(memcmp(&in[candidate], &in[ip], CRUD_COMPRESS_MIN_MATCH) != 0)) {
+			ip++;
+			continue;
+		}
+
+		// Extend the match as far as it goes, then write the sequence
+		match = CRUD_COMPRESS_MIN_MATCH;
+		while ((ip + match < length - CRUD_COMPRESS_LAST_LITERALS) && (in[candidate + match] == in[ip + match])) {
+			match++;
+		}
+		if (compress_sequence(dst, &pos, capacity, &in[anchor], ip - anchor, ip - candidate, match) != 0) {
+			return(-1);
+		}
+		ip += match;
+		anchor = ip;
+	}
+
+	// The rest goes as literals
+	if (compress_sequence(dst, &pos, capacity, &in[anchor], length - anchor, 0, 0) != 0) {
+		return(-1);
+	}
+	return((int32_t)pos);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : decompress_crud_buffer
+// Description  : Decompress a buffer, checking every length and offset
+//                against the input and the output
+//
+// Inputs       : src - the compressed data, length - number of bytes
+//                dst - the output, capacity - size of the output
+// Outputs      : the decompressed size, -1 if the input is bad or too big
+
+int32_t decompress_crud_buffer(const void *src, uint32_t length, void *dst, uint32_t capacity) {
+
+	const uint8_t *in = src;
+	uint8_t *out = dst, b;
+	uint32_t ip = 0, op = 0, lit, match, offset, i;
+
+	while (ip < length) {
+
+		// The literals
+		lit = in[ip] >> 4;
+		match = in[ip++] & 0xf;
+		if (lit == 15) {
+			do {
+				if (ip >= length) {
+					return(-1);
+				}
+				b = in[ip++];
+				lit += b;
+			} while (b == 255);
+		}
+		if ((lit > length - ip) || (lit > capacity - op)) {
+			return(-1);
+		}
+		memcpy(&out[op], &in[ip], lit);
+		ip += lit;
+		op += lit;
+		if (ip == length) {
+			break;
+		}
+
+		// The back reference (copied a byte at a time, it may overlap itself)
+		if (length - ip < 2) {
+			return(-1);
+		}
+		offset = in[ip] | (in[ip+1] << 8);
+		ip += 2;
+		if (match == 15) {
+			do {
+				if (ip >= length) {
+					return(-1);
+				}
+				b = in[ip++];
+				match += b;
+			} while (b == 255);
+		}
+		match += CRUD_COMPRESS_MIN_MATCH;
+		if ((offset == 0) || (offset > op) || (match > capacity - op)) {
+			return(-1);
+		}
+		for (i=0; i<match; i++, op++) {
+			out[op] = out[op - offset];
+		}
+	}
+	return((int32_t)op);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudCompressUnitTest
+// Description  : Perform a test of the compressor by round tripping text
+//                like, random and constant buffers of random sizes
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crudCompressUnitTest(void) {
+
+	// Local variables
+	static const char *words[] = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ",
+		"lazy ", "dog ", "to ", "be ", "or ", "not ", "that ", "is ", "question\n" };
+	char *src, *cmp, *out;
+	uint32_t i, j, k, len, kind, w, textIn = 0, textOut = 0;
+	int32_t clen, dlen;
+
+	// Get the buffers (the compressed one can be a little bigger than the data)
+	src = malloc(CRUD_COMPRESS_UNIT_TEST_SIZE);
+	cmp = malloc(CRUD_COMPRESS_UNIT_TEST_SIZE + CRUD_COMPRESS_UNIT_TEST_SIZE/100 + 16);
+	out = malloc(CRUD_COMPRESS_UNIT_TEST_SIZE);
+	if ((src == NULL) || (cmp == NULL) || (out == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_COMPRESS_UNIT_TEST : buffer allocation failed.");
+		free(src); free(cmp); free(out);
+		return(-1);
+	}
+
+	for (i=0; i<CRUD_COMPRESS_UNIT_TEST_ITERATIONS; i++) {
+
+		// Fill a buffer with text, random bytes or one value
+		len = (i < 16) ? i : getRandomValue(1, CRUD_COMPRESS_UNIT_TEST_SIZE);
+		kind = i % 3;
+		for (j=0; j<len; ) {
+			if (kind == 0) {
+				w = getRandomValue(0, sizeof(words)/sizeof(words[0])-1);
+				for (k=0; (j < len) && (words[w][k] != 0); k++) {
+					src[j++] = words[w][k];
+				}
+			} else {
+				src[j++] = (kind == 1) ? (char)getRandomValue(0, 255) : 'x';
+			}
+		}
+
+		// Round trip it
+		clen = compress_crud_buffer(src, len, cmp, CRUD_COMPRESS_UNIT_TEST_SIZE + CRUD_COMPRESS_UNIT_TEST_SIZE/100 + 16);
+		if (clen < 0) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_COMPRESS_UNIT_TEST : compression of %u bytes failed.", len);
+			free(src); free(cmp); free(out);
+			return(-1);
+		}
+		dlen = decompress_crud_buffer(cmp, clen, out, len);
+		if ((dlen != (int32_t)len) || (memcmp(src, out, len) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_COMPRESS_UNIT_TEST : round trip of %u bytes failed.", len);
+			free(src); free(cmp); free(out);
+			return(-1);
+		}
+
+		// Output too small must be refused, not overrun
+		if ((len > 0) && (decompress_crud_buffer(cmp, clen, out, len - 1) != -1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_COMPRESS_UNIT_TEST : short output not detected.");
+			free(src); free(cmp); free(out);
+			return(-1);
+		}
+		if ((kind == 1) && (len > 0) && (compress_crud_buffer(src, len, cmp, len / 2) != -1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_COMPRESS_UNIT_TEST : random data compressed by half.");
+			free(src); free(cmp); free(out);
+			return(-1);
+		}
+		if ((kind != 1) && (len > 1000)) {
+			textIn += len;
+			textOut += clen;
+		}
+	}
+
+	// Repetitive data must actually shrink
+	if (textOut * 2 > textIn) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_COMPRESS_UNIT_TEST : poor compression (%u to %u bytes).", textIn, textOut);
+		free(src); free(cmp); free(out);
+		return(-1);
+	}
+
+	// Cleanup
+	free(src);
+	free(cmp);
+	free(out);
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "CRUD compress unit test completed successfully (%u bytes to %u).", textIn, textOut);
+	return(0);
+}
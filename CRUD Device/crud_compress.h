@@ -0,0 +1,30 @@
+#ifndef CRUD_COMPRESS_INCLUDED
+#define CRUD_COMPRESS_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_compress.h
+//  Description    : This is the interface for the block compressor the CRUD
+//                   client uses for object payloads.  It is a fast LZ77 coder
+//                   (LZ4 style sequences of literals and back references).
+//
+
+// Includes
+#include <stdint.h>
+
+//
+// Compression interface
+
+int32_t compress_crud_buffer(const void *src, uint32_t length, void *dst, uint32_t capacity);
+	// Compress length bytes of src into dst, returns the compressed size (-1 if it does not fit)
+
+int32_t decompress_crud_buffer(const void *src, uint32_t length, void *dst, uint32_t capacity);
+	// Decompress length bytes of src into dst, returns the original size (-1 if bad or too big)
+
+//
+// Unit testing for the module
+
+int crudCompressUnitTest(void);
+	// Perform a test of the compression implementation
+
+#endif
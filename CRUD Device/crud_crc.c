@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_crc.c
+//  Description    : This is the implementation of the CRC32C checksum of the
+//                   CRUD client.  On x86-64 processors with SSE4.2 the crc32
+//                   instruction does eight bytes at a time; elsewhere eight
+//                   lookup tables do the same (slicing by 8).  Both give the
+//                   same result, the choice is made once at first use.
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// Project includes
+#include <crud_crc.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_CRC_POLYNOMIAL 0x82f63b78 // Castagnoli polynomial (reversed)
+#define CRUD_CRC_UNIT_TEST_SIZE (1024*1024)
+#define CRUD_CRC_UNIT_TEST_ITERATIONS 256
+#define CRUD_CRC_UNIT_TEST_ROUNDS 64
+
+//
+// Module local data
+
+static uint32_t crc_table[8][256];  // The lookup tables (table 0 is byte at a time)
+static int crc_hardware_ok = 0;     // Flag indicating the crc32 instruction is there
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT; // Sets up the tables once
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc_setup
+// Description  : Build the lookup tables, check for the crc32 instruction
+//
+// Inputs       : none
+// Outputs      : none
+
+static void crc_setup(void) {
+
+	uint32_t i, j, crc;
+
+	for (i=0; i<256; i++) {
+		crc = i;
+		for (j=0; j<8; j++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRUD_CRC_POLYNOMIAL : crc >> 1;
+		}
+		crc_table[0][i] = crc;
+	}
+	for (i=0; i<256; i++) {
+		for (j=1; j<8; j++) {
+			crc_table[j][i] = (crc_table[j-1][i] >> 8) ^ crc_table[0][crc_table[j-1][i] & 0xff];
+		}
+	}
+#if defined(__x86_64__)
+	crc_hardware_ok = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc_software
+// Description  : Run the CRC over a buffer with the lookup tables
+//
+// Inputs       : crc - the CRC so far, p - the bytes, length - how many
+// Outputs      : the CRC
+
+static uint32_t crc_software(uint32_t crc, const uint8_t *p, uint32_t length) {
+
+	uint32_t lo, hi;
+
+	for (; length >= 8; p += 8, length -= 8) {
+		lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+		hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+		crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+			crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+			crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+			crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+	}
+	while (length--) {
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+	return(crc);
+}
+
+#if defined(__x86_64__)
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc_hardware
+// Description  : Run the CRC over a buffer with the SSE4.2 crc32 instruction
+//
+// Inputs       : crc - the CRC so far, p - the bytes, length - how many
+// Outputs      : the CRC
+
+__attribute__((target("sse4.2")))
+static uint32_t crc_hardware(uint32_t crc, const uint8_t *p, uint32_t length) {
+
+	uint64_t v, c = crc;
+
+	for (; length >= 8; p += 8, length -= 8) {
+		memcpy(&v, p, sizeof(v));
+		c = _mm_crc32_u64(c, v);
+	}
+	crc = (uint32_t)c;
+	while (length--) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+	return(crc);
+}
+#endif
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checksum_crud_buffer
+// Description  : Get the CRC32C of a buffer
+//
+// Inputs       : buf - the bytes, length - how many
+// Outputs      : the checksum
+
+uint32_t checksum_crud_buffer(const void *buf, uint32_t length) {
+
+	pthread_once(&crc_once, crc_setup);
+#if defined(__x86_64__)
+	if (crc_hardware_ok) {
+		return(~crc_hardware(0xffffffff, buf, length));
+	}
+#endif
+	return(~crc_software(0xffffffff, buf, length));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudCrcUnitTest
+// Description  : Perform a test of the checksum: the standard check value,
+//                the hardware and table versions agreeing on buffers of all
+//                lengths and alignments, then time it against the SHA-1
+//                signature (generate_md5_signature) over the same buffer
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crudCrcUnitTest(void) {
+
+	// Local variables
+	unsigned char *buf, sig[64];
+	uint32_t i, off, len, sigsz;
+	struct timeval start, end;
+	long crcTime, shaTime;
+	volatile uint32_t sum = 0;
+
+	// The check value of the CRC-32C specification
+	if (checksum_crud_buffer("123456789", 9) != 0xe3069283) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_CRC_UNIT_TEST : bad check value [%x].", checksum_crud_buffer("123456789", 9));
+		return(-1);
+	}
+
+	// Both versions must agree, whatever the length and alignment
+	if ((buf = malloc(CRUD_CRC_UNIT_TEST_SIZE)) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_CRC_UNIT_TEST : buffer allocation failed.");
+		return(-1);
+	}
+	for (i=0; i<CRUD_CRC_UNIT_TEST_SIZE; i++) {
+		buf[i] = (unsigned char)getRandomValue(0, 255);
+	}
+	for (i=0; i<CRUD_CRC_UNIT_TEST_ITERATIONS; i++) {
+		off = getRandomValue(0, 15);
+		len = (i < 32) ? i : getRandomValue(0, CRUD_CRC_UNIT_TEST_SIZE/16);
+		if (checksum_crud_buffer(&buf[off], len) != ~crc_software(0xffffffff, &buf[off], len)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_CRC_UNIT_TEST : versions disagree on %u bytes at %u.", len, off);
+			free(buf);
+			return(-1);
+		}
+	}
+
+	// Time the checksum against the signature
+	gettimeofday(&start, NULL);
+	for (i=0; i<CRUD_CRC_UNIT_TEST_ROUNDS; i++) {
+		sum += checksum_crud_buffer(buf, CRUD_CRC_UNIT_TEST_SIZE);
+	}
+	gettimeofday(&end, NULL);
+	crcTime = compareTimes(&start, &end);
+	gettimeofday(&start, NULL);
+	for (i=0; i<CRUD_CRC_UNIT_TEST_ROUNDS; i++) {
+		sigsz = sizeof(sig);
+		if (generate_md5_signature(buf, CRUD_CRC_UNIT_TEST_SIZE, sig, &sigsz) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_CRC_UNIT_TEST : signature failed.");
+			free(buf);
+			return(-1);
+		}
+	}
+	gettimeofday(&end, NULL);
+	shaTime = compareTimes(&start, &end);
+	logMessage(LOG_INFO_LEVEL, "CRUD crc : CRC32C (%s) %.1f MB/s, SHA-1 %.1f MB/s over %d MB.",
+			(crc_hardware_ok) ? "sse4.2" : "tables",
+			(crcTime > 0) ? (double)CRUD_CRC_UNIT_TEST_ROUNDS*1000000.0/crcTime : 0.0,
+			(shaTime > 0) ? (double)CRUD_CRC_UNIT_TEST_ROUNDS*1000000.0/shaTime : 0.0,
+			CRUD_CRC_UNIT_TEST_ROUNDS);
+
+	// Cleanup
+	free(buf);
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "CRUD crc unit test completed successfully.");
+	return(0);
+}
@@ -0,0 +1,28 @@
+#ifndef CRUD_CRC_INCLUDED
+#define CRUD_CRC_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_crc.h
+//  Description    : This is the interface for the CRC32C (Castagnoli)
+//                   checksum the CRUD client keeps on object contents.  The
+//                   SSE4.2 crc32 instruction is used when the processor has
+//                   it, a table driven version otherwise.
+//
+
+// Includes
+#include <stdint.h>
+
+//
+// Checksum interface
+
+uint32_t checksum_crud_buffer(const void *buf, uint32_t length);
+	// Get the CRC32C of length bytes of buf
+
+//
+// Unit testing for the module
+
+int crudCrcUnitTest(void);
+	// Perform a test of the checksum implementation (and time it against SHA-1)
+
+#endif
@@ -33,7 +33,12 @@ typedef enum {
 	CRUD_DELETE  = 5, // Delete an object
 	CRUD_CLOSE   = 6, // Close the CRUD device
 	CRUD_UNKNOWN = 7, // Unknown type
-	CRUD_MAXVAL  = 8, // Max value
+	CRUD_READ_RANGE = 8, // Read a byte range of an object (extension)
+	CRUD_UPDATE_RANGE = 9, // Update a byte range of an object (extension)
+	CRUD_APPEND  = 10, // Append bytes to the end of an object (extension)
+	CRUD_TRUNCATE = 11, // Cut an object to a size or zero fill it out to one (extension)
+	CRUD_COPY    = 12, // Make a new object holding a copy of an object (extension)
+	CRUD_MAXVAL  = 13, // Max value
 } CRUD_REQUEST_TYPES;
 const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL];
 
@@ -41,13 +46,15 @@ const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL];
 typedef enum {
 	CRUD_NULL_FLAG       = 0,  // This is the "no flag" flag
 	CRUD_PRIORITY_OBJECT = 1,  // Flag indicating that object is a "priority object"
-	CRUD_FLAGMAX         = 2,  // Max value
+	CRUD_COMPRESSED_OBJECT = 2, // Flag indicating the object contents are compressed
+	CRUD_FLAGMAX         = 3,  // Max value
 } CRUD_FLAG_TYPES;
 const char *CRUD_FLAG_TYPE_LABLES[CRUD_FLAGMAX];
 
 // CRUD request and response types
 typedef uint64_t CrudRequest;
 typedef uint64_t CrudResponse;
+typedef uint64_t CrudRange;
 
 /*
 
@@ -66,9 +73,45 @@ typedef uint64_t CrudResponse;
    0-31 - OID - the object ID (0 if not relevant)
   32-35 - Request type - this is the request type (CRUD_REQUEST_TYPES)
   36-59 - Length - this is the size of the object in bytes
-  60-62 - Flags - these are flags for commands (UNUSED)
+  60-62 - Flags - these are flags for commands (CRUD_FLAG_TYPES), the flags
+          given when an object is created or updated are stored with it and
+          returned in the response to each read of it
      63 - R - this is the result bit (0 success, 1 is failure)
 
+ Range Extension (ranged requests only)
+
+ Ranged requests (CRUD_READ_RANGE, CRUD_UPDATE_RANGE) are followed on the
+ wire by a second 64-bit word giving the byte offset into the object.  For
+ CRUD_READ_RANGE the Length field of the request is the number of bytes
+ wanted; the Length field of the response is the number of bytes returned
+ (clipped at the end of the object), and that many bytes follow the response.
+ For CRUD_UPDATE_RANGE the Length bytes that follow the range word replace
+ the object contents at the offset, and the range must lie inside the object.
+
+ CRUD_APPEND carries no range word: the Length bytes following the request
+ are added to the end of the object, growing it by Length bytes.
+
+ CRUD_TRUNCATE carries no range word and no bytes: the object is resized to
+ Length bytes, dropping the bytes past that or adding zeros up to it.  The
+ Length field of the response is the new size.
+
+ CRUD_COPY carries no range word and no bytes: the server makes a new object
+ holding the contents (and flags) of the object named by the OID of the
+ request.  The OID of the response is the new object, its Length the size.
+
+  0                   1                   2                   3
+  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |                            Reserved                           |
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |                             Offset                            |
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+  Bits    Description
+  -----   -------------------------------------------------------------
+   0-31 - Reserved - must be 0
+  32-63 - Offset - the byte offset into the object
+
 */
 
 //
@@ -101,4 +144,13 @@ int deconstruct_crud_request(CrudRequest request, CrudOID *oid,
 		uint8_t *res);
     // Extract values from a 64-bit bus request buffer
 
+int crud_request_is_ranged(CRUD_REQUEST_TYPES req);
+    // Does the request type carry a range extension word?
+
+CrudRange construct_crud_range(uint32_t offset);
+    // Create a 64-bit range extension word
+
+int deconstruct_crud_range(CrudRange range, uint32_t *offset);
+    // Extract values from a 64-bit range extension word
+
 #endif
@@ -11,25 +11,53 @@
 // Includes
 #include <malloc.h>
 #include <string.h>
+#include <stddef.h>
+#include <pthread.h>
 
 // Project Includes
 #include <crud_file_io.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <crud_network.h>
+#include <crud_cache.h>
+#include <crud_pool.h>
+#include <crud_compress.h>
+#include <crud_crc.h>
 
 // Defines
 #define CIO_UNIT_TEST_MAX_WRITE_SIZE 1024
 #define CRUD_IO_UNIT_TEST_ITERATIONS 10240
+#define CRUD_IO_UNIT_TEST_TABLE_FILES (2*CRUD_PATH_HASH_BUCKETS+CRUD_FILES_PER_PAGE+17) // Past a path index rehash
+#define CRUD_IO_UNIT_TEST_ASYNC_FILES 8
+#define CRUD_IO_UNIT_TEST_THREADS 4
+#define CRUD_IO_UNIT_TEST_THREAD_READS 256
+#define CRUD_IO_UNIT_TEST_SHARED_LENGTH (5*CRUD_CHUNK_SIZE+123)
+#define CRUD_PATH_HASH_BUCKETS 1024 // Initial number of buckets in the path index (power of 2)
+#define CRUD_NO_SLOT 0xffffffff // Marks the end of a path index chain
+#define CRUD_LIST_BATCH 64 // Files crud_list looks up each time it takes the file system lock
+#define CRUD_MIN_CHUNK_CAPACITY 256 // Smallest chunk object, doubled up to CRUD_CHUNK_SIZE
+#define CRUD_WRITE_BUFFER_CHUNKS 16 // Chunks an open file buffers writes for before writing them out
+#define CRUD_READ_AHEAD_CHUNKS 16 // Chunk reads an open file can have in flight
+#define CRUD_READ_AHEAD_MAX_WINDOW 8 // Most chunks read ahead of a sequential read
+#define CRUD_NO_POSITION 0xffffffff // Read ahead position before the first read
+#define CRUD_ASYNC_OP_TICKETS 32 // Updates an asynchronous operation can have in flight
+#define CRUD_MAP_BLOCK 64 // Granularity mapped views are compared at for changes
+#define CRUD_DEDUP_HASH_LENGTH 20 // Size of a chunk contents hash (generate_md5_signature, SHA-1)
+#define CRUD_DEDUP_BUCKETS 4096 // Number of buckets of each dedup index chain (power of 2)
+#define CRUD_MAX_DEDUP_ENTRIES (CRUD_MAX_OBJECT_SIZE/sizeof(CrudDedupEntry)) // Entries the index object can hold
+#define CRUD_MAX_SHARD_CHECKSUMS (CRUD_MAX_OBJECT_SIZE/sizeof(CrudChecksum)) // Entries a checksum shard object can hold
+#define CRUD_NAME_FILTER_HASHES 4 // Bits of the name filter each path sets
+#define CRUD_NAME_FILTER_BITS_PER_FILE 16 // Name filter bits per file, it is rebuilt twice the size past this
+#define CRUD_MIN_NAME_FILTER_LENGTH 4096 // Smallest name filter in bytes (power of 2)
+#define CRUD_MAX_NAME_FILTER_LENGTH 0x80000 // Largest name filter in bytes (power of 2 that fits in an object)
 
 // Other definitions
 
 //typedef struct {
 //	char      filename[CRUD_MAX_PATH_LENGTH]; // The filename of the data to be manipulated
-//	CrudOID   object_id;                      // The handle of the object
-//	uint32_t  position;                       // This is the position of the file
+//	CrudOID   chunks[CRUD_DIRECT_CHUNKS];     // The objects holding the first chunks
+//	CrudOID   extent_map;                     // Object listing the OIDs of the remaining chunks
 //	uint32_t  length;                         // This is the length of the file
-//	uint8_t   open;                           // Flag indicating the file is currently open
 //} CrudFileAllocationType;
 
 // Type for UNIT test interface
@@ -40,9 +68,214 @@ typedef enum {
 	CIO_UNIT_TEST_SEEK   = 3,
 } CRUD_UNIT_TEST_TYPE;
 
+// This is the in-memory copy of a file's extent map object (not persisted)
+typedef struct {
+	CrudOID  *chunks; // OIDs of chunks CRUD_DIRECT_CHUNKS and up
+	uint32_t  count;  // Number of entries in chunks
+	uint32_t  stored; // Number of entries in the extent map object
+	uint8_t   loaded; // Flag indicating the map has been read in
+	uint8_t   dirty;  // Flag indicating the map must be written back
+} CrudExtentMap;
+
+// This is an entry of the dedup index, a chunk object shared by every chunk
+// of a file written with the same contents (persisted in the index object)
+typedef struct {
+	unsigned char hash[CRUD_DEDUP_HASH_LENGTH]; // Hash of the chunk contents
+	CrudOID   oid;   // Object holding the contents
+	uint32_t  refs;  // Number of file chunks referring to the object
+	uint32_t  flags; // CRUD_FILE_COMPRESSED if written by a compressed file
+} CrudDedupEntry;
+
+// This is a slot of the in-memory dedup index, chained by hash and by OID
+typedef struct {
+	CrudDedupEntry entry;
+	uint32_t  hash_next; // Next slot in the same hash bucket (next free slot if unused)
+	uint32_t  oid_next;  // Next slot in the same OID bucket
+} CrudDedupSlot;
+
+// This is the checksum of the contents of an object (persisted in the shard object of the OID)
+typedef struct {
+	CrudOID   oid; // The object
+	uint32_t  crc; // CRC32C of its contents (uncompressed)
+} CrudChecksum;
+
+// This is an in-memory shard of the checksum index (read from its object on
+// first use): the entries are kept as laid out in the object, open addressed
+// slots point at them
+typedef struct {
+	CrudChecksum *entries; // The entries of the shard
+	uint32_t  count;    // Number of entries
+	uint32_t  room;     // Number of entries allocated
+	uint32_t *slots;    // Entry in each slot (CRUD_NO_SLOT if unused)
+	uint32_t  capacity; // Number of slots (power of 2)
+	uint32_t  dirty_lo; // First entry that changed
+	uint32_t  dirty_hi; // Last entry that changed (lo > hi if none)
+	uint8_t   loaded;   // Flag indicating the shard has been read in
+	uint8_t   full;     // Flag indicating the shard filled up (logged once)
+} CrudChecksumShard;
+
+// This is a record of the path directory, the slot of a file with the path
+// hash (persisted in the bucket object of the hash)
+typedef struct {
+	uint32_t  hash; // Path hash of the file
+	uint32_t  slot; // Slot of the file in the file table
+} CrudPathRecord;
+
+// This is an in-memory bucket of the path directory (read from its object on
+// first use), records are only ever added to the end
+typedef struct {
+	CrudPathRecord *records; // The records, as laid out in the bucket object
+	uint32_t  count;  // Number of records
+	uint32_t  room;   // Number of records allocated
+	uint8_t   loaded; // Flag indicating the bucket has been read in
+} CrudPathBucket;
+
+// This is an in-memory page of the file table (read from its object on first use)
+typedef struct {
+	CrudFileAllocationType *entries; // The entries of the page, NULL if not loaded
+	int16_t  *handles;               // Open file handle of each entry, -1 if closed
+	uint32_t *hashes;                // Path hash of each entry (path index)
+	uint32_t *next;                  // Next slot in the same path index bucket
+	uint32_t  dirty_entries[CRUD_FILES_PER_PAGE/32]; // Bitmap of the entries that changed
+	uint8_t   dirty;                 // Flag indicating the page must be written back
+} CrudTablePage;
+
+// This is the in-memory state of a page list object (the OIDs are in crud_page_oids)
+typedef struct {
+	uint8_t   loaded;   // Flag indicating the list has been read in
+	uint32_t  dirty_lo; // First page OID of the list that changed
+	uint32_t  dirty_hi; // Last page OID of the list that changed (lo > hi if none)
+} CrudPageList;
+
+// This is an open file, the file handle is the index into the open file table
+typedef struct {
+	uint32_t  slot;     // Index of the file's entry in the file table
+	uint32_t  position; // This is the position of the file
+	uint8_t   open;     // Flag indicating the handle is in use
+} CrudOpenFile;
+
+// This is one chunk of buffered writes of an open file, the bytes between lo
+// and hi are the file contents with the writes applied
+typedef struct {
+	char     *data; // Contents of the chunk (CRUD_CHUNK_SIZE), NULL until used
+	uint32_t  idx;  // Index of the chunk in the file
+	uint32_t  lo;   // Offset of the first buffered byte
+	uint32_t  hi;   // Offset one past the last buffered byte
+} CrudWriteChunk;
+
+// This is the write buffer of an open file, writes not yet sent to the chunk objects
+typedef struct {
+	CrudWriteChunk chunks[CRUD_WRITE_BUFFER_CHUNKS]; // The buffered chunks
+	uint32_t  count; // Number of chunks in use
+	uint32_t  end;   // Position one past the last buffered byte
+} CrudWriteBuffer;
+
+// This is a chunk of an open file being read ahead of the reader
+typedef struct {
+	char     *data;   // Buffer the chunk object is read into
+	uint32_t  idx;    // Index of the chunk in the file
+	CrudOID   oid;    // Object holding the chunk
+	uint32_t  length; // Size of the chunk object
+	int       ticket; // Ticket of the posted read
+} CrudReadAheadChunk;
+
+// This is the read ahead state of an open file
+typedef struct {
+	CrudReadAheadChunk chunks[CRUD_READ_AHEAD_CHUNKS]; // The chunk reads in flight
+	uint32_t  count;  // Number of chunks in flight
+	uint32_t  next;   // Position a sequential read would start at
+	uint32_t  window; // Chunks read past the end of a read (doubles while sequential)
+} CrudReadAhead;
+
+// Type of an asynchronous operation
+typedef enum {
+	CRUD_ASYNC_FREE  = 0, // Handle unused
+	CRUD_ASYNC_READ  = 1,
+	CRUD_ASYNC_WRITE = 2,
+	CRUD_ASYNC_FLUSH = 3,
+} CRUD_ASYNC_TYPE;
+
+// This is an asynchronous operation that has been started but not waited for
+typedef struct {
+	CRUD_ASYNC_TYPE type;   // Type of the operation
+	uint8_t   done;   // Flag indicating the operation has finished
+	int16_t   fd;     // File the operation is on
+	char     *buf;    // The callers buffer (reads)
+	uint32_t  pos;    // Position the read starts at
+	int32_t   count;  // Number of bytes to read
+	int32_t   result; // What the synchronous call would return
+	int       tickets[CRUD_ASYNC_OP_TICKETS]; // Updates posted for the operation
+	uint32_t  posted; // Number of tickets
+} CrudAsyncOp;
+
+// This is a mapped view of a range of an open file
+typedef struct {
+	char     *data;   // The view handed to the caller, NULL if unused
+	char     *clean;  // The file contents as last read/written back (writable views)
+	int16_t   fd;     // File the view is of
+	uint32_t  offset; // Position of the first byte of the view
+	uint32_t  length; // Number of bytes in the view
+	int       flags;  // CRUD_MAP_READ/CRUD_MAP_WRITE
+} CrudMappedView;
+
 // File system Static Data
 // This the definition of the file table
-CrudFileAllocationType crud_file_table[CRUD_MAX_TOTAL_FILES]; // The file handle table
+CrudFileTableRoot crud_table_root;        // The root of the file table (priority object)
+uint8_t  crud_table_root_dirty = 0;       // Flag indicating the root must be written back
+CrudTablePage *crud_table_pages = NULL;   // The pages of the file table
+CrudOID *crud_page_oids = NULL;           // The object of each page, read in a page list at a time
+CrudPageList crud_page_lists[CRUD_MAX_PAGE_LISTS]; // The page lists
+uint32_t crud_table_page_capacity = 0;    // Number of pages crud_table_pages can hold
+uint32_t crud_table_pages_loaded = 0;     // Number of pages read in so far
+CrudOpenFile crud_open_files[CRUD_MAX_OPEN_FILES]; // The file handle table
+CrudExtentMap crud_extent_maps[CRUD_MAX_OPEN_FILES]; // The loaded extent maps (by handle)
+CrudWriteBuffer crud_write_buffers[CRUD_MAX_OPEN_FILES]; // The write buffers (by handle)
+CrudReadAhead crud_read_aheads[CRUD_MAX_OPEN_FILES]; // The read ahead state (by handle)
+CrudAsyncOp crud_async_ops[CRUD_MAX_ASYNC_OPS]; // The asynchronous operations (by completion handle)
+CrudAsyncOp *crud_async_deferring = NULL; // Operation the updates being sent are posted for
+CrudMappedView crud_views[CRUD_MAX_MAPPED_VIEWS]; // The mapped views
+int crud_file_compression = 0;            // Flag indicating new files are stored compressed
+
+// The dedup index (chunk contents -> shared chunk object), read in on first use
+CrudDedupSlot *crud_dedup_slots = NULL;             // The slots of the index
+uint32_t crud_dedup_capacity = 0;                   // Number of slots allocated
+uint32_t crud_dedup_used = 0;                       // Number of slots ever handed out
+uint32_t crud_dedup_free = CRUD_NO_SLOT;            // First unused slot below crud_dedup_used
+uint32_t crud_dedup_count = 0;                      // Number of entries in the index
+uint32_t crud_dedup_hash_buckets[CRUD_DEDUP_BUCKETS]; // First slot in each hash bucket
+uint32_t crud_dedup_oid_buckets[CRUD_DEDUP_BUCKETS];  // First slot in each OID bucket
+uint8_t  crud_dedup_loaded = 0;                     // Flag indicating the index has been read in
+uint32_t crud_dedup_dirty_lo = 1;                   // First slot that changed
+uint32_t crud_dedup_dirty_hi = 0;                   // Last slot that changed (lo > hi if none)
+
+// The checksum index (OID -> CRC32C), its shards read in as objects in them
+// are written or checked; reads sharing the file system lock check objects,
+// so the shards have a lock of their own
+CrudChecksumShard crud_checksum_shards[CRUD_CHECKSUM_SHARDS]; // The shards (by OID modulo)
+uint8_t  crud_checksums_open = 0;           // Flag indicating the index is in use (mounted)
+pthread_mutex_t crud_checksum_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes the shards
+
+// The name filter (Bloom filter of the paths in the table), read in at mount
+uint8_t *crud_name_filter = NULL;           // The bits of the filter, NULL if there is none
+uint32_t crud_name_filter_length = 0;       // Size of the filter in bytes (power of 2)
+uint32_t crud_name_filter_lo = 1;           // First byte of the filter that changed
+uint32_t crud_name_filter_hi = 0;           // Last byte of the filter that changed (lo > hi if none)
+uint8_t  crud_name_filter_new = 0;          // Flag indicating the filter needs a new object
+
+// The path index (path -> slot) over the loaded pages and the free handle list
+uint32_t *crud_path_buckets = NULL;                 // First slot in each bucket
+uint32_t crud_path_bucket_count = 0;                // Number of buckets (power of 2)
+uint32_t crud_path_indexed = 0;                     // Number of slots in the index
+CrudPathBucket crud_path_directory[CRUD_PATH_DIRECTORY_BUCKETS]; // The path directory (path hash -> slot)
+int16_t  crud_free_handles[CRUD_MAX_OPEN_FILES];    // Stack of unused handles (lowest on top)
+int16_t  crud_free_count = 0;                       // Number of handles on the stack
+
+// The name index (slots in path order) for listings, built by the first one
+uint32_t *crud_name_slots = NULL;    // Slots of the files, in path order up to crud_name_sorted
+uint32_t crud_name_count = 0;        // Number of slots in the index
+uint32_t crud_name_sorted = 0;       // Number of slots at the front that are in order
+uint32_t crud_name_capacity = 0;     // Number of slots allocated
+uint8_t  crud_names_built = 0;       // Flag indicating the index has been built
 
 // Pick up these definitions from the unit test of the crud driver
 CrudRequest construct_crud_request(CrudOID oid, CRUD_REQUEST_TYPES req,
@@ -53,6 +286,66 @@ int deconstruct_crud_request(CrudRequest request, CrudOID *oid,
 
 int init = 0;
 
+// The file system lock: positional reads share it, everything else holds it
+// exclusively (the cache and the connection have their own locks)
+pthread_rwlock_t crud_io_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Module local functions (defined below)
+int flushExtentMap(int16_t fd);
+int flushWriteBuffer(int16_t fd);
+void dropReadAhead(int16_t fd);
+void dropObjectReadAhead(CrudOID oid);
+void finishAsyncReads(int16_t fd);
+int deferRequest(CrudRequest request, uint32_t offset, void *buf);
+int releaseExtentMap(int16_t fd);
+int writeRange(CrudOID oid, uint32_t offset, uint32_t count, void *buf);
+int writeIndexObject(CrudOID *oid, uint32_t *stored, char *records, uint32_t size, uint32_t count, uint32_t lo, uint32_t hi);
+int resetFileTable(void);
+void resetDedupIndex(void);
+int flushDedupIndex(void);
+void resetChecksums(void);
+void openChecksums(void);
+int flushChecksums(void);
+void setChecksum(CrudOID oid, char *data, uint32_t length);
+void copyChecksum(CrudOID oid, CrudOID copy);
+int verifyChecksum(CrudOID oid, char *data, uint32_t length);
+void resetNameFilter(void);
+int buildNameFilter(void);
+int loadNameFilter(void);
+int addNameFilter(char *path);
+void resetPathDirectory(void);
+int addPathRecord(uint32_t slot);
+int flushPathDirectory(void);
+int inNameFilter(char *path);
+int flushNameFilter(void);
+int syncFileTable(void);
+uint16_t formatFileSystem(void);
+uint16_t mountFileSystem(void);
+uint16_t unmountFileSystem(void);
+uint16_t syncFileSystem(void);
+int16_t openFile(char *path);
+int16_t closeFile(int16_t fh);
+int32_t readFile(int16_t fd, void *buf, int32_t count);
+int32_t writeFile(int16_t fd, void *buf, int32_t count);
+int32_t readvFile(int16_t fd, const struct iovec *iov, int iovcnt);
+int32_t writevFile(int16_t fd, const struct iovec *iov, int iovcnt);
+int32_t seekFile(int16_t fd, uint32_t loc);
+int32_t flushFile(int16_t fd);
+int32_t compressFile(int16_t fd);
+int32_t truncateFile(int16_t fd, uint32_t length);
+int32_t cloneFile(char *src, char *dst);
+int32_t statFile(char *path, CrudFileStat *stat);
+int32_t listFiles(char *prefix, char *after, CrudFileStat *stats, uint32_t max);
+CrudCompletion readFileAsync(int16_t fd, void *buf, int32_t count);
+CrudCompletion writeFileAsync(int16_t fd, void *buf, int32_t count);
+CrudCompletion flushFileAsync(int16_t fd);
+int pollAsyncOp(CrudCompletion op);
+int32_t waitAsyncOp(CrudCompletion op);
+int releaseViews(int16_t fd);
+void *mapView(int16_t fd, uint32_t offset, uint32_t length, int flags);
+int32_t syncView(void *view);
+int32_t unmapView(void *view);
+
 //
 // Implementation
 
@@ -81,6 +374,19 @@ return;
 // Outputs      : 0 if successful, -1 if failure
 
 uint16_t crud_format(void) {
+uint16_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = formatFileSystem();
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_format, called with the file system locked
+//IN: see crud_format
+//Out: see crud_format
+uint16_t formatFileSystem(void){
 	CrudOID ID;
 	int32_t length;
 	int result;
@@ -107,20 +413,20 @@ uint16_t crud_format(void) {
 	if(result != 0)
 		return-1;
 
-	//initializes table with zeros
-	for(int i = 0; i < CRUD_MAX_TOTAL_FILES; i++){
-		strcpy(crud_file_table[i].filename, ""); 
-		crud_file_table[i].object_id= 0;                      
-		crud_file_table[i].position= 0;                       
-		crud_file_table[i].length = 0;                        
-		crud_file_table[i].open = 0;  
-	}
+	//every object is gone, so start with an empty cache
+	close_crud_cache();
+	if(init_crud_cache() != 0)
+		return -1;
 
+	//initializes an empty table, no pages until files are created
+	memset(&crud_table_root, 0, sizeof(CrudFileTableRoot));
+	if(resetFileTable() != 0 || loadNameFilter() != 0)
+		return -1;
+	openChecksums();
 	
-	
-	//creates priority object for storing the file table
-	request = construct_crud_request(0, CRUD_CREATE, CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), CRUD_PRIORITY_OBJECT,0);
-	response = crud_client_operation(request,crud_file_table); 
+	//creates priority object for storing the root of the file table
+	request = construct_crud_request(0, CRUD_CREATE, sizeof(CrudFileTableRoot), CRUD_PRIORITY_OBJECT,0);
+	response = crud_client_operation(request,&crud_table_root); 
 	decryptResponse(response,&ID,&length, &result);// decrypt response
 	
 	if(result !=0)
@@ -142,6 +448,19 @@ uint16_t crud_format(void) {
 // Outputs      : 0 if successful, -1 if failure
 
 uint16_t crud_mount(void) {
+uint16_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = mountFileSystem();
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_mount, called with the file system locked
+//IN: see crud_mount
+//Out: see crud_mount
+uint16_t mountFileSystem(void){
 CrudOID ID;
 int32_t length=0;
 int result;
@@ -159,13 +478,21 @@ CrudResponse response;
 		init = 1;
     	}
 
-	request = construct_crud_request(0, CRUD_READ, CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), CRUD_PRIORITY_OBJECT,0);
-	response = crud_client_operation(request,crud_file_table); 
+	//only the root of the table is read, pages are read as files use them
+	request = construct_crud_request(0, CRUD_READ, sizeof(CrudFileTableRoot), CRUD_PRIORITY_OBJECT,0);
+	response = crud_client_operation(request,&crud_table_root); 
 	decryptResponse(response,&ID,&length, &result);// decrypt response
 	
 	if(result !=0)
 		return -1;
 
+	//setup the object cache and the in-memory table, read the name filter so
+	//paths that are not there are not looked for (the checksum shards are
+	//read as they are used)
+	if(init_crud_cache() != 0 || resetFileTable() != 0 || loadNameFilter() != 0)
+		return -1;
+	openChecksums();
+
 	// Log, return successfully
 	logMessage(LOG_INFO_LEVEL, "... mount complete.");
 	return(0);
@@ -181,6 +508,19 @@ CrudResponse response;
 // Outputs      : 0 if successful, -1 if failure
 
 uint16_t crud_unmount(void) {
+uint16_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = unmountFileSystem();
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_unmount, called with the file system locked
+//IN: see crud_unmount
+//Out: see crud_unmount
+uint16_t unmountFileSystem(void){
 CrudOID ID;
 int32_t length=0;
 int result;
@@ -192,10 +532,17 @@ CrudResponse response;
 	if(init == 0)
 		return -1;
 
-	request = construct_crud_request(0, CRUD_UPDATE,CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), CRUD_PRIORITY_OBJECT,0);
-	response = crud_client_operation(request,crud_file_table); 
-	decryptResponse(response,&ID,&length, &result);// decrypt response
-	if(result !=0)
+	//finish reads in flight, write out mapped views, buffered bytes and extent
+	//maps first, they may change the file table
+	for(int i = 0; i < CRUD_MAX_OPEN_FILES; i++){
+		if(crud_open_files[i].open)
+			finishAsyncReads(i);
+		if(crud_open_files[i].open && (releaseViews(i) != 0 || flushWriteBuffer(i) != 0 || releaseExtentMap(i) != 0))
+			return -1;
+	}
+
+	//write back the pages that changed and the root
+	if(syncFileTable() != 0)
 		return -1;
 
 	request = construct_crud_request(0,CRUD_CLOSE,0,CRUD_NULL_FLAG,0);
@@ -204,11 +551,59 @@ CrudResponse response;
 	if(result !=0)
 		return -1;
 
+	init = 0;
+
+	//drop the cached objects and the table, report the cache and pool statistics
+	close_crud_cache();
+	resetFileTable();
+	close_crud_pool();
+
 	// Log, return successfully
 	logMessage(LOG_INFO_LEVEL, "... unmount complete.");
 	return (0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_sync
+// Description  : This function writes out the buffered writes and extent maps
+//                of open files and the parts of the file allocation table
+//                that changed, without unmounting.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+uint16_t crud_sync(void) {
+uint16_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = syncFileSystem();
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_sync, called with the file system locked
+//IN: see crud_sync
+//Out: see crud_sync
+uint16_t syncFileSystem(void){
+
+	if(init == 0)
+		return -1;
+
+	//write out buffered bytes and extent maps first, they may change the file table
+	for(int i = 0; i < CRUD_MAX_OPEN_FILES; i++)
+		if(crud_open_files[i].open && (flushWriteBuffer(i) != 0 || flushExtentMap(i) != 0))
+			return -1;
+
+	if(syncFileTable() != 0)
+		return -1;
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "... sync complete.");
+	return (0);
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 //Function : Forms a CrudRequest from the given information
 //IN: a pointer to a CrudRequest, and info to form a request
@@ -244,367 +639,4468 @@ void formRequest(CrudRequest *request,int32_t OID, int task, int32_t size){
 //Out: i is it is open; 0 if it is closed
 int openCheck(int16_t fd){
 
-	//checks for the open marker in storage
-	if (crud_file_table[fd].open!=1)
+	//checks for the open marker in the handle table
+	if (fd < 0 || fd >= CRUD_MAX_OPEN_FILES || crud_open_files[fd].open!=1)
 		return 1;
 	else 
 		return 0;
 }
 
+//////////////////////////////////////////////////////////////////////////////////
+//Function : hashes a path for the path index (FNV-1a)
+//IN: the path
+//Out: the hash value
+uint32_t pathHash(char *path){
+uint32_t hash = 2166136261u;
+
+	while(*path != '\0')
+		hash = (hash ^ (uint8_t)*path++) * 16777619u;
+	return hash;
+}
 
-//
-// Implementation
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gets the table entry of a slot (the page must be loaded)
+//IN: the slot in the file table
+//Out: pointer to the entry
+CrudFileAllocationType *slotEntry(uint32_t slot){
 
-////////////////////////////////////////////////////////////////////////////////
-//
-// Function     : crud_open
-// Description  : This function opens the file and returns a file handle
-//
-// Inputs       : path - the path "in the storage array"
-// Outputs      : file handle if successful, -1 if failure
+	return &crud_table_pages[slot / CRUD_FILES_PER_PAGE].entries[slot % CRUD_FILES_PER_PAGE];
+}
 
-int16_t crud_open(char *path) {
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gets the table entry of an open file (its page stays loaded)
+//IN: file descriptor
+//Out: pointer to the entry
+CrudFileAllocationType *fileEntry(int16_t fd){
+
+	return slotEntry(crud_open_files[fd].slot);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : marks a table entry as changed (its page must be loaded)
+//IN: the slot in the file table
+//Out: none
+void markSlotDirty(uint32_t slot){
+CrudTablePage *page = &crud_table_pages[slot / CRUD_FILES_PER_PAGE];
+
+	page->dirty_entries[(slot % CRUD_FILES_PER_PAGE) / 32] |= 1u << (slot % 32);
+	page->dirty = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : marks the table entry of an open file as changed
+//IN: file descriptor
+//Out: none
+void markFileDirty(int16_t fd){
+
+	markSlotDirty(crud_open_files[fd].slot);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : marks a page OID in its page list as changed
+//IN: the page number
+//Out: none
+void markPageOidDirty(uint32_t idx){
+CrudPageList *list = &crud_page_lists[idx / CRUD_PAGE_LIST_PAGES];
+
+	idx %= CRUD_PAGE_LIST_PAGES;
+	if(list->dirty_lo > list->dirty_hi)
+		list->dirty_lo = list->dirty_hi = idx;
+	else if(idx < list->dirty_lo)
+		list->dirty_lo = idx;
+	else if(idx > list->dirty_hi)
+		list->dirty_hi = idx;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads the OIDs of a page list object in (if not already), the
+//           pages added since it was written have no object yet
+//IN: the page list number
+//Out: 0 if successful, -1 if failure
+int loadPageList(uint32_t idx){
 CrudOID ID;
 int32_t length=0;
 int result;
 CrudRequest request;
 CrudResponse response;
-//
-//Local variables
-//
+CrudIndexRef *ref = &crud_table_root.page_lists[idx];
 
-//check to see if the Crud system is initialized
-// if not then it initialies the system
-	if(init == 0){
-		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
-		response = crud_client_operation(request,NULL); 
-		decryptResponse(response,&ID,&length, &result);	
-		if(result!=0)
+	if(crud_page_lists[idx].loaded)
+		return 0;
+	if(ref->oid != CRUD_NO_OBJECT){
+		request = construct_crud_request(ref->oid, CRUD_READ, ref->count * sizeof(CrudOID), 0,0);
+		response = crud_client_operation(request,&crud_page_oids[idx * CRUD_PAGE_LIST_PAGES]);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0)
 			return -1;
-		init = 1;
-    	}
+	}
+	crud_page_lists[idx].loaded = 1;
+	crud_page_lists[idx].dirty_lo = 1;
+	crud_page_lists[idx].dirty_hi = 0;
+	return 0;
+}
 
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes the page lists that changed back to their objects (the
+//           pages must all have objects)
+//IN: none
+//Out: 0 if successful, -1 if failure
+int flushPageLists(void){
+CrudPageList *list;
+uint32_t i, count;
+
+	for(i = 0; i * CRUD_PAGE_LIST_PAGES < crud_table_root.pages; i++){
+		list = &crud_page_lists[i];
+		count = crud_table_root.pages - i * CRUD_PAGE_LIST_PAGES;
+		if(count > CRUD_PAGE_LIST_PAGES)
+			count = CRUD_PAGE_LIST_PAGES;
+		if(!list->loaded || (list->dirty_lo > list->dirty_hi && crud_table_root.page_lists[i].count == count))
+			continue;
+		if(writeIndexObject(&crud_table_root.page_lists[i].oid, &crud_table_root.page_lists[i].count,
+				(char *)&crud_page_oids[i * CRUD_PAGE_LIST_PAGES], sizeof(CrudOID), count, list->dirty_lo, list->dirty_hi) != 0)
+			return -1;
+		list->dirty_lo = 1;
+		list->dirty_hi = 0;
+	}
+	return 0;
+}
 
-// if the request was successful, finds an open index in storage
+//////////////////////////////////////////////////////////////////////////////////
+//Function : compares the paths of two slots for the name index (qsort)
+//IN: pointers to the slots
+//Out: less than, equal to or greater than 0 as strcmp of the paths
+int compareNames(const void *a, const void *b){
 
- 
-	int x = 0;
-	while( x < CRUD_MAX_TOTAL_FILES && (strcmp(crud_file_table[x].filename, path)!=0))
-		x++;
+	return strcmp(slotEntry(*(const uint32_t *)a)->filename, slotEntry(*(const uint32_t *)b)->filename);
+}
 
-//stores information about object in the found index
-	if (x == CRUD_MAX_TOTAL_FILES){
-        	// Assign file new slot in crud_file_table
-
-        	x = 0;
-       		// Search through file table until an empty slot is found
-        	while (strcmp(crud_file_table[x].filename, "") != 0)
-            		x++;
-
-        	// Copy path into filename 
-        	strcpy(crud_file_table[x].filename, path);
-        
-        	// Set initial contents to empty
-        	crud_file_table[x].object_id = 0;
-       	 	crud_file_table[x].position = 0;
-        	crud_file_table[x].length = 0;
-        	crud_file_table[x].open = 1;
-    	}
-	//else, the file already exists
-	else{
-		crud_file_table[x].position = 0;
-		crud_file_table[x].open = 1;
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds a slot to the end of the name index (it is put in order by
+//           the next listing)
+//IN: the slot in the file table
+//Out: 0 if successful, -1 if failure
+int addName(uint32_t slot){
+uint32_t *grown, capacity;
+
+	if(crud_name_count == crud_name_capacity){
+		capacity = (crud_name_capacity) ? 2 * crud_name_capacity : CRUD_FILES_PER_PAGE;
+		if((grown = realloc(crud_name_slots, capacity * sizeof(uint32_t))) == NULL)
+			return -1;
+		crud_name_slots = grown;
+		crud_name_capacity = capacity;
 	}
+	crud_name_slots[crud_name_count++] = slot;
+	return 0;
+}
 
-	
-	return x;//returns array index
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds a slot to the path index, doubling the buckets as it fills
+//IN: the slot in the file table
+//Out: 0 if successful, -1 if failure
+int indexPath(uint32_t slot){
+CrudTablePage *page;
+uint32_t *grown, bucket, i, cur, next, hash;
+
+	//keep the chains short, relink the slots already in the chains into
+	//twice the buckets (only they have their hash and link set)
+	if(crud_path_indexed >= 2 * crud_path_bucket_count){
+		if((grown = malloc(2 * crud_path_bucket_count * sizeof(uint32_t))) == NULL)
+			return -1;
+		for(i = 0; i < 2 * crud_path_bucket_count; i++)
+			grown[i] = CRUD_NO_SLOT;
+		for(i = 0; i < crud_path_bucket_count; i++){
+			for(cur = crud_path_buckets[i]; cur != CRUD_NO_SLOT; cur = next){
+				page = &crud_table_pages[cur / CRUD_FILES_PER_PAGE];
+				next = page->next[cur % CRUD_FILES_PER_PAGE];
+				bucket = page->hashes[cur % CRUD_FILES_PER_PAGE] & (2 * crud_path_bucket_count - 1);
+				page->next[cur % CRUD_FILES_PER_PAGE] = grown[bucket];
+				grown[bucket] = cur;
+			}
+		}
+		free(crud_path_buckets);
+		crud_path_buckets = grown;
+		crud_path_bucket_count *= 2;
+	}
 
+	page = &crud_table_pages[slot / CRUD_FILES_PER_PAGE];
+	hash = pathHash(page->entries[slot % CRUD_FILES_PER_PAGE].filename);
+	bucket = hash & (crud_path_bucket_count - 1);
+	page->hashes[slot % CRUD_FILES_PER_PAGE] = hash;
+	page->next[slot % CRUD_FILES_PER_PAGE] = crud_path_buckets[bucket];
+	crud_path_buckets[bucket] = slot;
+	crud_path_indexed++;
+
+	//files created once the name index is built go on its end
+	if(crud_names_built && addName(slot) != 0)
+		return -1;
+	return 0;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-//
-// Function     : crud_close
-// Description  : This function closes the file
-//
-// Inputs       : fd - the file handle of the object to close
-// Outputs      : 0 if successful, -1 if failure
+//////////////////////////////////////////////////////////////////////////////////
+//Function : makes room in memory for another table page
+//IN: none
+//Out: 0 if successful, -1 if failure
+int growTablePages(void){
+CrudTablePage *grown;
+CrudOID *oids;
+uint32_t capacity;
+
+	if(crud_table_root.pages < crud_table_page_capacity)
+		return 0;
+	capacity = (crud_table_page_capacity) ? 2 * crud_table_page_capacity : 16;
+	if((oids = realloc(crud_page_oids, capacity * sizeof(CrudOID))) == NULL)
+		return -1;
+	memset(&oids[crud_table_page_capacity], 0, (capacity - crud_table_page_capacity) * sizeof(CrudOID));
+	crud_page_oids = oids;
+	if((grown = realloc(crud_table_pages, capacity * sizeof(CrudTablePage))) == NULL)
+		return -1;
+	memset(&grown[crud_table_page_capacity], 0, (capacity - crud_table_page_capacity) * sizeof(CrudTablePage));
+	crud_table_pages = grown;
+	crud_table_page_capacity = capacity;
+	return 0;
+}
 
-int16_t crud_close(int16_t fh) {
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads a table page from its object (if not already) and indexes it
+//IN: the page number
+//Out: 0 if successful, -1 if failure
+int loadTablePage(uint32_t idx){
 CrudOID ID;
 int32_t length=0;
 int result;
 CrudRequest request;
 CrudResponse response;
+CrudTablePage *page = &crud_table_pages[idx];
+uint32_t i;
 
-	
-	//check to see if the Crud system is initialized
-	// if not then it initialies the system
-	if(init == 0){
-		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
-		response = crud_client_operation(request,NULL); 
-		decryptResponse(response,&ID,&length, &result);	
-		if(result!=0)
-			return -1;
-		init = 1;
-    	}
-
-	//check if the file is open
-	if(crud_file_table[fh].open==0)
+	if(page->entries != NULL)
+		return 0;
+	if(loadPageList(idx / CRUD_PAGE_LIST_PAGES) != 0)
 		return -1;
 
-	// change the open marker to 0 and return 0
+	page->entries = calloc(CRUD_FILES_PER_PAGE, sizeof(CrudFileAllocationType));
+	page->handles = malloc(CRUD_FILES_PER_PAGE * sizeof(int16_t));
+	page->hashes = malloc(CRUD_FILES_PER_PAGE * sizeof(uint32_t));
+	page->next = malloc(CRUD_FILES_PER_PAGE * sizeof(uint32_t));
+	if(page->entries == NULL || page->handles == NULL || page->hashes == NULL || page->next == NULL)
+		return -1;
+	for(i = 0; i < CRUD_FILES_PER_PAGE; i++)
+		page->handles[i] = -1;
+
+	//a page that was never written back has no object yet
+	if(crud_page_oids[idx] != CRUD_NO_OBJECT){
+		request = construct_crud_request(crud_page_oids[idx], CRUD_READ, CRUD_FILES_PER_PAGE*sizeof(CrudFileAllocationType), 0,0);
+		response = crud_client_operation(request,page->entries);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0)
+			return -1;
+	}
+	memset(page->dirty_entries, 0, sizeof(page->dirty_entries));
+	page->dirty = 0;
+	crud_table_pages_loaded++;
 
-	crud_file_table[fh].open = 0;
+	for(i = 0; i < CRUD_FILES_PER_PAGE; i++)
+		if(page->entries[i].filename[0] != '\0' && indexPath(idx * CRUD_FILES_PER_PAGE + i) != 0)
+			return -1;
 	return 0;
+}
 
-
+//////////////////////////////////////////////////////////////////////////////////
+//Function : looks up a path in the path index (the loaded pages)
+//IN: the path and its hash
+//Out: the slot, CRUD_NO_SLOT if the path is not in a loaded page
+uint32_t lookupPath(char *path, uint32_t hash){
+uint32_t slot = crud_path_buckets[hash & (crud_path_bucket_count - 1)];
+CrudTablePage *page;
+
+	//only compare the strings when the full hashes match
+	while(slot != CRUD_NO_SLOT){
+		page = &crud_table_pages[slot / CRUD_FILES_PER_PAGE];
+		if(page->hashes[slot % CRUD_FILES_PER_PAGE] == hash &&
+		   strcmp(page->entries[slot % CRUD_FILES_PER_PAGE].filename, path) == 0)
+			return slot;
+		slot = page->next[slot % CRUD_FILES_PER_PAGE];
+	}
+	return CRUD_NO_SLOT;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-//
-// Function     : crud_read
-// Description  : Reads up to "count" bytes from the file handle "fh" into the
-//                buffer  "buf".
-//
-// Inputs       : fd - the file descriptor for the read
-//                buf - the buffer to place the bytes into
-//                count - the number of bytes to read
-// Outputs      : the number of bytes read or -1 if failures
+//////////////////////////////////////////////////////////////////////////////////
+//Function : drops the in-memory path directory so its buckets are read again
+//IN: none
+//Out: none
+void resetPathDirectory(void){
+uint32_t i;
+
+	for(i = 0; i < CRUD_PATH_DIRECTORY_BUCKETS; i++){
+		free(crud_path_directory[i].records);
+		memset(&crud_path_directory[i], 0, sizeof(CrudPathBucket));
+	}
+}
 
-int32_t crud_read(int16_t fd, void *buf, int32_t count) {
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads a bucket of the path directory in (if not already)
+//IN: the bucket number
+//Out: 0 if successful, -1 if failure
+int loadPathBucket(uint32_t idx){
 CrudOID ID;
 int32_t length=0;
 int result;
 CrudRequest request;
 CrudResponse response;
+CrudPathBucket *bucket = &crud_path_directory[idx];
+CrudIndexRef *ref = &crud_table_root.path_directory[idx];
 
-int pos = crud_file_table[fd].position;
-int amtRead = 0;
-void *temp= malloc(crud_file_table[fd].length);
-//
-//local variables
-//
-
-	//check to see if the Crud system is initialized
-	// if not then it initialies the system
-	if(init == 0){
-		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
-		response = crud_client_operation(request,NULL); 
-		decryptResponse(response,&ID,&length, &result);	
-		if(result!=0)
+	if(bucket->loaded)
+		return 0;
+	if(ref->oid != CRUD_NO_OBJECT){
+		if((bucket->records = malloc(ref->count * sizeof(CrudPathRecord))) == NULL)
+			return -1;
+		bucket->room = ref->count;
+		request = construct_crud_request(ref->oid, CRUD_READ, ref->count * sizeof(CrudPathRecord), 0,0);
+		response = crud_client_operation(request,bucket->records);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0){
+			free(bucket->records);
+			memset(bucket, 0, sizeof(CrudPathBucket));
 			return -1;
-		init = 1;
-    	}
-
-	//check to see is the file is open 
-	if(crud_file_table[fd].open == 0)
-		return -1;	
-	
-	if(crud_file_table[fd].object_id != 0){//check to see if the file has an OID
-
-		request = construct_crud_request(crud_file_table[fd].object_id,CRUD_READ,crud_file_table[fd].length,0,0);//create a read request
-		response = crud_client_operation(request,temp);// submit request with the temp buffer
-		decryptResponse(response,&ID,&length, &result);// decrypt response
-
-		if(result == 0){//if request was successful
-
-			//copy temp[pos] to buf for 'count' bits
-			if (count > crud_file_table[fd].length - crud_file_table[fd].position)
-				memcpy(buf, temp+crud_file_table[fd].position, crud_file_table[fd].length - crud_file_table[fd].position);
-			else	
-				memcpy(buf, temp+crud_file_table[fd].position, count);
-		
-			// determine the amount read to the passed buffer then adjust the position of the file 
-			if(length<pos+count){
-				amtRead= length-pos;
-				crud_file_table[fd].position = crud_file_table[fd].length;
-			}
-
-			else{
-				amtRead= count;	
-				crud_file_table[fd].position += count;
-			}
 		}
-
-	free(temp);// free the temp buffer
+		bucket->count = ref->count;
 	}
+	bucket->loaded = 1;
+	return 0;
+}
 
-	else 
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds a new file to the path directory (its slot must be indexed)
+//IN: the slot in the file table
+//Out: 0 if successful, -1 if failure
+int addPathRecord(uint32_t slot){
+uint32_t hash = crud_table_pages[slot / CRUD_FILES_PER_PAGE].hashes[slot % CRUD_FILES_PER_PAGE];
+uint32_t idx = hash & (CRUD_PATH_DIRECTORY_BUCKETS - 1);
+CrudPathBucket *bucket = &crud_path_directory[idx];
+CrudPathRecord *grown;
+uint32_t room;
+
+	if(loadPathBucket(idx) != 0)
 		return -1;
-
-
-	return amtRead;
+	if(bucket->count == bucket->room){
+		room = (bucket->room) ? 2 * bucket->room : 64;
+		if((grown = realloc(bucket->records, room * sizeof(CrudPathRecord))) == NULL)
+			return -1;
+		bucket->records = grown;
+		bucket->room = room;
+	}
+	bucket->records[bucket->count].hash = hash;
+	bucket->records[bucket->count].slot = slot;
+	bucket->count++;
+	return 0;
 }
 
-/////////////////////////////////////////////////////////////////////////////////
-//
-// Function     : crud_write
-// Description  : Writes "count" bytes to the file handle "fh" from the
-//                buffer  "buf"
-//
-// Inputs       : fd - the file descriptor for the file to write to
-//                buf - the buffer to write
-//                count - the number of bytes to write
-// Outputs      : the number of bytes written or -1 if failure
-
-int32_t crud_write(int16_t fd, void *buf, int32_t count){
-
-CrudOID ID;
-int32_t length =0;
-int result;
-CrudRequest request;
-CrudResponse response;
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes the records added to the path directory to their buckets
+//IN: none
+//Out: 0 if successful, -1 if failure
+int flushPathDirectory(void){
+CrudPathBucket *bucket;
+CrudIndexRef *ref;
+uint32_t i;
+
+	for(i = 0; i < CRUD_PATH_DIRECTORY_BUCKETS; i++){
+		bucket = &crud_path_directory[i];
+		ref = &crud_table_root.path_directory[i];
+		if(bucket->loaded && bucket->count != ref->count &&
+				writeIndexObject(&ref->oid, &ref->count, (char *)bucket->records, sizeof(CrudPathRecord), bucket->count, 1, 0) != 0)
+			return -1;
+	}
+	return 0;
+}
 
-//
-//local variables
-//
+//////////////////////////////////////////////////////////////////////////////////
+//Function : looks up a path in the path index, when it is not in the pages
+//           read so far (and the name filter does not rule it out) the path
+//           directory bucket of its hash says which pages to read in
+//IN: the path, place to put the slot
+//Out: 0 if successful (slot is CRUD_NO_SLOT if the path is not in the table), -1 if failure
+int findPath(char *path, uint32_t *slot){
+uint32_t hash = pathHash(path);
+uint32_t idx = hash & (CRUD_PATH_DIRECTORY_BUCKETS - 1);
+uint32_t i, loaded;
+
+	if((*slot = lookupPath(path, hash)) != CRUD_NO_SLOT)
+		return 0;
 
-	//check to see if the Crud system is initialized
-	// if not then it initialies the system
-	if(init == 0){
-		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
-		response = crud_client_operation(request,NULL); 
-		decryptResponse(response,&ID,&length, &result);	
-		if(result!=0)
+	//a name filter that was out of date at mount is built now (from every page)
+	if(crud_name_filter == NULL){
+		if(buildNameFilter() != 0)
 			return -1;
-		init = 1;
-    	}
+		*slot = lookupPath(path, hash);
+		return 0;
+	}
 
-	//check to see if file is open
-	if(!crud_file_table[fd].open)
-		return -1;
+	//every page has been searched, or the path was never added to the name filter
+	if(crud_table_pages_loaded == crud_table_root.pages || !inNameFilter(path))
+		return 0;
 
-	if(crud_file_table[fd].object_id == 0){// check to see if file has an OID
-		request = construct_crud_request(0,CRUD_CREATE,count,0,0);//create read request
-		response = crud_client_operation(request,buf);//submit request
-		decryptResponse(response,&ID,&length, &result);	//decypher request
-		if(result !=0)
+	//only the pages of the files with the same hash can hold it
+	if(loadPathBucket(idx) != 0)
+		return -1;
+	loaded = crud_table_pages_loaded;
+	for(i = 0; i < crud_path_directory[idx].count; i++)
+		if(crud_path_directory[idx].records[i].hash == hash &&
+				loadTablePage(crud_path_directory[idx].records[i].slot / CRUD_FILES_PER_PAGE) != 0)
 			return -1;
+	if(crud_table_pages_loaded != loaded)
+		*slot = lookupPath(path, hash);
+	return 0;
+}
 
-		//update information of the file at the index
-		crud_file_table[fd].object_id = ID;
-		crud_file_table[fd].position = count;	
-		crud_file_table[fd].length = count;
-
-		return count;// return amount wrote
+//////////////////////////////////////////////////////////////////////////////////
+//Function : puts the name index in path order, building it from every page
+//           the first time (the files added since are sorted and merged in)
+//IN: none
+//Out: 0 if successful, -1 if failure
+int sortNames(void){
+uint32_t *merged, i, j, k;
+
+	if(!crud_names_built){
+		for(i = 0; i < crud_table_root.pages; i++)
+			if(loadTablePage(i) != 0)
+				return -1;
+		crud_name_count = crud_name_sorted = 0;
+		for(i = 0; i < crud_table_root.files; i++)
+			if(slotEntry(i)->filename[0] != '\0' && addName(i) != 0)
+				return -1;
+		crud_names_built = 1;
 	}
+	if(crud_name_sorted == crud_name_count)
+		return 0;
 
-	else{
-		request = construct_crud_request(crud_file_table[fd].object_id, CRUD_READ,  crud_file_table[fd].length, 0,0);
-		char *temp= malloc(crud_file_table[fd].length);
-		response = crud_client_operation(request,temp); 
-		decryptResponse(response,&ID,&length, &result);	
-		if(result!=0){
-			free(temp);
+	//sort the new slots, then merge them with the ones already in order
+	qsort(&crud_name_slots[crud_name_sorted], crud_name_count - crud_name_sorted, sizeof(uint32_t), compareNames);
+	if(crud_name_sorted > 0){
+		if((merged = malloc(crud_name_count * sizeof(uint32_t))) == NULL)
 			return -1;
+		for(i = 0, j = crud_name_sorted, k = 0; k < crud_name_count; k++){
+			if(j == crud_name_count || (i < crud_name_sorted && compareNames(&crud_name_slots[i], &crud_name_slots[j]) < 0))
+				merged[k] = crud_name_slots[i++];
+			else
+				merged[k] = crud_name_slots[j++];
+		}
+		free(crud_name_slots);
+		crud_name_slots = merged;
+		crud_name_capacity = crud_name_count;
+	}
+	crud_name_sorted = crud_name_count;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finds where a listing starts in the name index (in path order)
+//IN: the prefix, the last path listed (NULL to start at the prefix)
+//Out: position of the first path after "after" (not before "prefix" if NULL)
+uint32_t findName(char *prefix, char *after){
+uint32_t lo = 0, hi = crud_name_count, mid;
+char *name;
+
+	while(lo < hi){
+		mid = lo + (hi - lo) / 2;
+		name = slotEntry(crud_name_slots[mid])->filename;
+		if((after != NULL) ? strcmp(name, after) <= 0 : strcmp(name, prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : fills in what crud_stat reports about a file (its page must be loaded)
+//IN: the slot in the file table, place to put it
+//Out: none
+void statSlot(uint32_t slot, CrudFileStat *stat){
+CrudFileAllocationType *entry = slotEntry(slot);
+int16_t fd = crud_table_pages[slot / CRUD_FILES_PER_PAGE].handles[slot % CRUD_FILES_PER_PAGE];
+
+	strncpy(stat->path, entry->filename, CRUD_MAX_PATH_LENGTH);
+	stat->length = entry->length;
+	stat->flags = entry->flags;
+
+	//an open file may have buffered writes past the end in the entry
+	if(fd != -1 && crud_write_buffers[fd].count > 0 && crud_write_buffers[fd].end > stat->length)
+		stat->length = crud_write_buffers[fd].end;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : takes the next unused slot of the table, adding a page if needed
+//IN: place to put the slot
+//Out: 0 if successful, -1 if failure (table full)
+int allocateSlot(uint32_t *slot){
+uint32_t idx;
+
+	if(crud_table_root.files == CRUD_MAX_TOTAL_FILES)
+		return -1;
+	*slot = crud_table_root.files;
+	idx = *slot / CRUD_FILES_PER_PAGE;
+
+	//first slot of a new page, the page gets its object when written back
+	if(idx == crud_table_root.pages){
+		if(growTablePages() != 0)
+			return -1;
+		crud_page_oids[idx] = CRUD_NO_OBJECT;
+		crud_table_root.pages++;
+	}
+	if(loadTablePage(idx) != 0)
+		return -1;
+
+	crud_table_root.files++;
+	crud_table_root_dirty = 1;
+	markSlotDirty(*slot);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : drops the in-memory table (pages, path index, handles) so it is
+//           read again from the root on demand
+//IN: none
+//Out: 0 if successful, -1 if failure (no room for the pages or path index)
+int resetFileTable(void){
+uint32_t i;
+int ret = 0;
+
+	for(i = 0; i < crud_table_page_capacity; i++){
+		free(crud_table_pages[i].entries);
+		free(crud_table_pages[i].handles);
+		free(crud_table_pages[i].hashes);
+		free(crud_table_pages[i].next);
+	}
+	free(crud_table_pages);
+	free(crud_page_oids);
+	crud_table_pages = NULL;
+	crud_page_oids = NULL;
+	crud_table_page_capacity = 0;
+	crud_table_pages_loaded = 0;
+	crud_table_root_dirty = 0;
+	for(i = 0; i < CRUD_MAX_PAGE_LISTS; i++){
+		crud_page_lists[i].loaded = 0;
+		crud_page_lists[i].dirty_lo = 1;
+		crud_page_lists[i].dirty_hi = 0;
+	}
+
+	//room for the pages counted in the root, their OIDs are read with them
+	while(crud_table_page_capacity < crud_table_root.pages)
+		crud_table_page_capacity = (crud_table_page_capacity) ? 2 * crud_table_page_capacity : 16;
+	if(crud_table_page_capacity > 0 && ((crud_table_pages = calloc(crud_table_page_capacity, sizeof(CrudTablePage))) == NULL ||
+			(crud_page_oids = calloc(crud_table_page_capacity, sizeof(CrudOID))) == NULL)){
+		free(crud_table_pages);
+		crud_table_pages = NULL;
+		crud_table_page_capacity = 0;
+		ret = -1;
+	}
+
+	free(crud_path_buckets);
+	crud_path_bucket_count = CRUD_PATH_HASH_BUCKETS;
+	if((crud_path_buckets = malloc(crud_path_bucket_count * sizeof(uint32_t))) == NULL){
+		crud_path_bucket_count = 0;
+		ret = -1;
+	}
+	for(i = 0; i < crud_path_bucket_count; i++)
+		crud_path_buckets[i] = CRUD_NO_SLOT;
+	crud_path_indexed = 0;
+
+	//the name index is built again by the next listing
+	free(crud_name_slots);
+	crud_name_slots = NULL;
+	crud_name_count = crud_name_sorted = crud_name_capacity = 0;
+	crud_names_built = 0;
+
+	//reads still in flight fail, their files are gone
+	for(i = 0; i < CRUD_MAX_ASYNC_OPS; i++){
+		if(crud_async_ops[i].type == CRUD_ASYNC_READ && !crud_async_ops[i].done){
+			crud_async_ops[i].result = -1;
+			crud_async_ops[i].done = 1;
+		}
+	}
+
+	//the mapped views go with their files, the indexes are read again
+	releaseViews(-1);
+	resetPathDirectory();
+	resetDedupIndex();
+	resetChecksums();
+	resetNameFilter();
+
+	//every handle is free, lowest ends up on top of the stack
+	crud_free_count = 0;
+	for(i = CRUD_MAX_OPEN_FILES; i > 0; i--){
+		crud_open_files[i-1].open = 0;
+		dropReadAhead(i-1);
+		free(crud_extent_maps[i-1].chunks);
+		memset(&crud_extent_maps[i-1], 0, sizeof(CrudExtentMap));
+		for(uint32_t j = 0; j < CRUD_WRITE_BUFFER_CHUNKS; j++)
+			free(crud_write_buffers[i-1].chunks[j].data);
+		memset(&crud_write_buffers[i-1], 0, sizeof(CrudWriteBuffer));
+		crud_free_handles[crud_free_count++] = i-1;
+	}
+
+	//without its pages or buckets the table is unusable until the next reset
+	if(ret != 0){
+		free(crud_path_buckets);
+		crud_path_buckets = NULL;
+		crud_path_bucket_count = 0;
+	}
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes back the table entries that changed, the page lists of
+//           new pages, then the root if it changed.  With the ranged request
+//           extension only the runs of changed entries go out, otherwise each
+//           changed page does.
+//IN: none
+//Out: 0 if successful, -1 if failure
+int syncFileTable(void){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+CrudTablePage *page;
+uint32_t i, j, k;
+
+	//the indexes go first, they may change the root
+	if(flushDedupIndex() != 0 || flushChecksums() != 0 || flushNameFilter() != 0 || flushPathDirectory() != 0)
+		return -1;
+
+	for(i = 0; i < crud_table_root.pages; i++){
+		page = &crud_table_pages[i];
+		if(page->entries == NULL || !page->dirty)
+			continue;
+
+		//pages are fixed size, a new page gets its object here
+		if(crud_page_oids[i] == CRUD_NO_OBJECT){
+			request = construct_crud_request(0, CRUD_CREATE, CRUD_FILES_PER_PAGE*sizeof(CrudFileAllocationType), 0,0);
+			response = crud_client_operation(request,page->entries);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+			crud_page_oids[i] = ID;
+			markPageOidDirty(i);
+		}
+		else if(crud_network_extensions){
+			//each run of changed entries is one ranged update
+			for(j = 0; j < CRUD_FILES_PER_PAGE; j = k){
+				for(k = j; k < CRUD_FILES_PER_PAGE && (page->dirty_entries[k / 32] & (1u << (k % 32))); k++);
+				if(k == j){
+					k++;
+					continue;
+				}
+				if(writeRange(crud_page_oids[i], j*sizeof(CrudFileAllocationType),
+						(k - j)*sizeof(CrudFileAllocationType), &page->entries[j]) != 0)
+					return -1;
+			}
+		}
+		else{
+			request = construct_crud_request(crud_page_oids[i], CRUD_UPDATE, CRUD_FILES_PER_PAGE*sizeof(CrudFileAllocationType), 0,0);
+			response = crud_client_operation(request,page->entries);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+		}
+		memset(page->dirty_entries, 0, sizeof(page->dirty_entries));
+		page->dirty = 0;
+	}
+
+	//the lists of the new pages, then the root (small, it goes out whole)
+	if(flushPageLists() != 0)
+		return -1;
+	if(!crud_table_root_dirty)
+		return 0;
+	request = construct_crud_request(0, CRUD_UPDATE, sizeof(CrudFileTableRoot), CRUD_PRIORITY_OBJECT,0);
+	response = crud_client_operation(request,&crud_table_root);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0)
+		return -1;
+	crud_table_root_dirty = 0;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : checks if the object a response is about is stored compressed
+//IN: a CrudResponse
+//Out: 1 if the object is compressed, 0 if not
+int compressedResponse(CrudResponse response){
+CrudOID ID;
+CRUD_REQUEST_TYPES req;
+uint32_t length;
+uint8_t flags, result;
+
+	deconstruct_crud_request(response, &ID, &req, &length, &flags, &result);
+	return (flags & CRUD_COMPRESSED_OBJECT) ? 1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : decompresses an object read from the server
+//IN: the bytes received and how many, the length of the object
+//Out: pool buffer holding the object contents, NULL if failure
+char *inflateObject(char *data, uint32_t received, uint32_t objLength){
+char *temp;
+
+	if((temp = alloc_crud_pool(objLength)) == NULL)
+		return NULL;
+	if(decompress_crud_buffer(data, received, temp, objLength) != (int32_t)objLength){
+		logMessage(LOG_ERROR_LEVEL, "CRUD IO : compressed object does not hold %u bytes", objLength);
+		free_crud_pool(temp);
+		return NULL;
+	}
+	return temp;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads a whole object from the server into a buffer (decompressed
+//           if it is stored compressed), checking it against its checksum
+//IN: the object ID and its length, the buffer (at least that long)
+//Out: 0 if successful, -1 if failure
+int readObject(CrudOID oid, uint32_t objLength, void *buf){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+char *temp;
+
+	request = construct_crud_request(oid, CRUD_READ, objLength, 0,0);
+	response = crud_client_operation(request,buf);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0)
+		return -1;
+
+	//the compressed bytes came in at the front of the buffer
+	if(compressedResponse(response)){
+		if((temp = inflateObject(buf, length, objLength)) == NULL)
+			return -1;
+		memcpy(buf, temp, objLength);
+		free_crud_pool(temp);
+	}
+	return verifyChecksum(oid, buf, objLength);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads a whole object from the server and puts it in the cache
+//IN: the object ID and its length
+//Out: pointer to the contents (owned by the cache, may be modified in place), NULL if failure
+char *fetchObject(CrudOID oid, uint32_t objLength){
+char *data, *temp;
+
+	//read the whole object from the server
+	if ((temp = alloc_crud_pool(objLength)) == NULL)
+		return NULL;
+	if(readObject(oid, objLength, temp) != 0){
+		free_crud_pool(temp);
+		return NULL;
+	}
+
+	//the cache takes the buffer over rather than copying it
+	init_crud_cache();
+	data = adopt_crud_cache(oid, temp, objLength);
+	return data;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gets the contents of an object, from the cache if it is there,
+//           otherwise reads it from the server and puts it in the cache
+//IN: the object ID and its length
+//Out: pointer to the contents (owned by the cache, may be modified in place), NULL if failure
+char *objectContents(CrudOID oid, uint32_t objLength){
+uint32_t cachedLength;
+char *data;
+
+	//check the cache first
+	if ((data = get_crud_cache(oid, &cachedLength)) != NULL)
+		return data;
+	return fetchObject(oid, objLength);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads a byte range of an object straight into the callers buffer
+//           (needs a server that supports the ranged request extension)
+//IN: the object ID, offset and number of bytes, and the buffer to fill
+//Out: number of bytes read, -1 if failure
+int32_t readRange(CrudOID oid, uint32_t offset, uint32_t count, void *buf){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+	request = construct_crud_request(oid, CRUD_READ_RANGE, count, 0,0);
+	response = crud_client_range_operation(request, offset, buf);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0)
+		return -1;
+	return length;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes a byte range of an object in place
+//           (needs a server that supports the ranged request extension)
+//IN: the object ID, offset and number of bytes, and the buffer to write
+//Out: 0 if successful, -1 if failure
+int writeRange(CrudOID oid, uint32_t offset, uint32_t count, void *buf){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+	request = construct_crud_request(oid, CRUD_UPDATE_RANGE, count, 0,0);
+	if(deferRequest(request, offset, buf) == 0)
+		return 0;
+	response = crud_client_range_operation(request, offset, buf);
+	decryptResponse(response,&ID,&length, &result);
+	return (result != 0) ? -1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds bytes to the end of an object
+//           (needs a server that supports the append extension)
+//IN: the object ID, number of bytes, and the buffer to write
+//Out: 0 if successful, -1 if failure
+int appendObject(CrudOID oid, uint32_t count, void *buf){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+	request = construct_crud_request(oid, CRUD_APPEND, count, 0,0);
+	response = crud_client_operation(request, buf);
+	decryptResponse(response,&ID,&length, &result);
+	return (result != 0) ? -1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : cuts an object to a size, or zero fills it out to one, without
+//           sending its bytes (needs a server that supports the truncate extension)
+//IN: the object ID and its new size
+//Out: 0 if successful, -1 if failure
+int resizeObject(CrudOID oid, uint32_t newLength){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+	request = construct_crud_request(oid, CRUD_TRUNCATE, newLength, 0,0);
+	response = crud_client_operation(request, NULL);
+	decryptResponse(response,&ID,&length, &result);
+	return (result != 0) ? -1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes an index kept in the table root back to its object.  With
+//           the extensions only the records that changed go out (the object
+//           is cut down or appended to as the index shrank or grew), otherwise
+//           it is updated whole, or replaced when its size changed.
+//IN: the object of the index (0 if none) and its number of records (both
+//    updated), the records, their size and number, the first and last
+//    record that changed
+//Out: 0 if successful, -1 if failure
+int writeIndexObject(CrudOID *oid, uint32_t *stored, char *records, uint32_t size, uint32_t count, uint32_t lo, uint32_t hi){
+CrudOID ID, old = *oid;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+uint32_t top;
+
+	if(old != CRUD_NO_OBJECT && count > 0 && crud_network_extensions){
+		//the changed records the object keeps are updated in place
+		top = (count < *stored) ? count : *stored;
+		if(hi + 1 < top)
+			top = hi + 1;
+		if(count < *stored && resizeObject(old, count * size) != 0)
+			return -1;
+		if(lo < top && writeRange(old, lo * size, (top - lo) * size, &records[lo * size]) != 0)
+			return -1;
+		if(count > *stored && appendObject(old, (count - *stored) * size, &records[*stored * size]) != 0)
+			return -1;
+	}
+	else if(old != CRUD_NO_OBJECT && count == *stored){
+		request = construct_crud_request(old, CRUD_UPDATE, count * size, 0,0);
+		response = crud_client_operation(request,records);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0)
+			return -1;
+	}
+	else{
+		*oid = CRUD_NO_OBJECT;
+		if(count > 0){
+			request = construct_crud_request(0, CRUD_CREATE, count * size, 0,0);
+			response = crud_client_operation(request,records);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+			*oid = ID;
+		}
+		if(old != CRUD_NO_OBJECT){
+			request = construct_crud_request(old, CRUD_DELETE, 0, 0,0);
+			response = crud_client_operation(request,NULL);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+		}
+	}
+
+	if(*oid != old || *stored != count)
+		crud_table_root_dirty = 1;
+	*stored = count;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : copies an object on the server, the copy has the checksum of the
+//           original (needs a server that supports the copy extension)
+//IN: the object ID, place to put the ID of the copy
+//Out: 0 if successful, -1 if failure
+int copyObject(CrudOID oid, CrudOID *copy){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+	request = construct_crud_request(oid, CRUD_COPY, 0, 0,0);
+	response = crud_client_operation(request, NULL);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0)
+		return -1;
+	copyChecksum(oid, ID);
+	*copy = ID;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : keeps a cached copy of an object in step with a write to it
+//IN: the object ID, its old and new lengths, and the bytes written at offset
+//Out: none
+void patchCachedObject(CrudOID oid, uint32_t objLength, uint32_t newLength, uint32_t offset, uint32_t count, char *buf){
+uint32_t cachedLength;
+char *data, *newBuf;
+
+	if((data = get_crud_cache(oid, &cachedLength)) == NULL)
+		return;
+
+	if(newLength == objLength){
+		memcpy(&data[offset], buf, count);
+		return;
+	}
+
+	if((newBuf = alloc_crud_pool(newLength)) == NULL){
+		delete_crud_cache(oid);
+		return;
+	}
+	memcpy(newBuf, data, objLength);
+	memset(&newBuf[objLength], 0, newLength - objLength);
+	memcpy(&newBuf[offset], buf, count);
+	adopt_crud_cache(oid, newBuf, newLength);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : the length of a chunk object for a file of a given length
+//IN: the chunk index and the file length
+//Out: length of the chunk in bytes
+uint32_t chunkLength(uint32_t idx, uint32_t fileLength){
+
+	if(fileLength <= idx * CRUD_CHUNK_SIZE)
+		return 0;
+	if(fileLength - idx * CRUD_CHUNK_SIZE > CRUD_CHUNK_SIZE)
+		return CRUD_CHUNK_SIZE;
+	return fileLength - idx * CRUD_CHUNK_SIZE;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : the size of the object holding a chunk of a file; chunk objects
+//           are allocated with spare room (doubling from CRUD_MIN_CHUNK_CAPACITY)
+//           so most appends fit in the object as it is, bytes past the end
+//           of the file are zeros
+//IN: the chunk index and the file length
+//Out: size of the chunk object in bytes
+uint32_t chunkCapacity(uint32_t idx, uint32_t fileLength){
+uint32_t length = chunkLength(idx, fileLength);
+uint32_t capacity = CRUD_MIN_CHUNK_CAPACITY;
+
+	if(length == 0)
+		return 0;
+	while(capacity < length)
+		capacity *= 2;
+	return capacity;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads a file's extent map object into memory (if not already)
+//IN: file descriptor
+//Out: 0 if successful, -1 if failure
+int loadExtentMap(int16_t fd){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+CrudExtentMap *map = &crud_extent_maps[fd];
+char *temp;
+
+	if(map->loaded)
+		return 0;
+
+	map->chunks = NULL;
+	map->count = map->stored = 0;
+	map->dirty = 0;
+
+	//read the map object, the response tells us how big it is
+	if(fileEntry(fd)->extent_map != CRUD_NO_OBJECT){
+		if((temp = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL)
+			return -1;
+		request = construct_crud_request(fileEntry(fd)->extent_map, CRUD_READ, CRUD_MAX_OBJECT_SIZE, 0,0);
+		response = crud_client_operation(request,temp);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0){
+			free(temp);
+			return -1;
+		}
+		map->count = map->stored = length / sizeof(CrudOID);
+		map->chunks = realloc(temp, (length) ? length : 1);
+	}
+
+	map->loaded = 1;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes a file's extent map back to its object (if changed)
+//IN: file descriptor
+//Out: 0 if successful, -1 if failure
+int flushExtentMap(int16_t fd){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+CrudExtentMap *map = &crud_extent_maps[fd];
+CrudOID oldMap = fileEntry(fd)->extent_map;
+
+	if(!map->loaded || !map->dirty)
+		return 0;
+
+	//same size, update in place; otherwise replace the object
+	if(oldMap != CRUD_NO_OBJECT && map->stored == map->count){
+		request = construct_crud_request(oldMap, CRUD_UPDATE, map->count * sizeof(CrudOID), 0,0);
+		response = crud_client_operation(request,map->chunks);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0)
+			return -1;
+	}
+	else{
+		fileEntry(fd)->extent_map = CRUD_NO_OBJECT;
+		markFileDirty(fd);
+		if(map->count > 0){
+			request = construct_crud_request(0, CRUD_CREATE, map->count * sizeof(CrudOID), 0,0);
+			response = crud_client_operation(request,map->chunks);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+			fileEntry(fd)->extent_map = ID;
+		}
+		if(oldMap != CRUD_NO_OBJECT){
+			request = construct_crud_request(oldMap, CRUD_DELETE, 0, 0,0);
+			response = crud_client_operation(request,NULL);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+		}
+	}
+
+	map->stored = map->count;
+	map->dirty = 0;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes back and releases the in-memory extent map of a file
+//IN: file descriptor
+//Out: 0 if successful, -1 if failure
+int releaseExtentMap(int16_t fd){
+
+	if(flushExtentMap(fd) != 0)
+		return -1;
+	free(crud_extent_maps[fd].chunks);
+	memset(&crud_extent_maps[fd], 0, sizeof(CrudExtentMap));
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finds the dedup index slot of a chunk contents hash
+//IN: the hash, the CRUD_FILE_COMPRESSED flag of the file writing it
+//Out: the slot, CRUD_NO_SLOT if the contents are not in the index
+uint32_t findDedupHash(unsigned char *hash, uint32_t flags){
+uint32_t slot, bucket;
+
+	memcpy(&bucket, hash, sizeof(bucket));
+	for(slot = crud_dedup_hash_buckets[bucket & (CRUD_DEDUP_BUCKETS - 1)]; slot != CRUD_NO_SLOT;
+			slot = crud_dedup_slots[slot].hash_next)
+		if(crud_dedup_slots[slot].entry.flags == flags &&
+		   memcmp(crud_dedup_slots[slot].entry.hash, hash, CRUD_DEDUP_HASH_LENGTH) == 0)
+			return slot;
+	return CRUD_NO_SLOT;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finds the dedup index slot of a chunk object
+//IN: the object ID
+//Out: the slot, CRUD_NO_SLOT if the object is not in the index
+uint32_t findDedupOid(CrudOID oid){
+uint32_t slot;
+
+	for(slot = crud_dedup_oid_buckets[oid & (CRUD_DEDUP_BUCKETS - 1)]; slot != CRUD_NO_SLOT;
+			slot = crud_dedup_slots[slot].oid_next)
+		if(crud_dedup_slots[slot].entry.oid == oid)
+			return slot;
+	return CRUD_NO_SLOT;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : marks a slot of the dedup index as changed
+//IN: the slot
+//Out: none
+void markDedupDirty(uint32_t slot){
+
+	if(crud_dedup_dirty_lo > crud_dedup_dirty_hi)
+		crud_dedup_dirty_lo = crud_dedup_dirty_hi = slot;
+	else if(slot < crud_dedup_dirty_lo)
+		crud_dedup_dirty_lo = slot;
+	else if(slot > crud_dedup_dirty_hi)
+		crud_dedup_dirty_hi = slot;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : takes the next slot of the dedup index that was never used,
+//           doubling the slots as needed
+//IN: place to put the slot
+//Out: 0 if successful, -1 if failure
+int takeDedupSlot(uint32_t *slot){
+CrudDedupSlot *grown;
+
+	if(crud_dedup_used == crud_dedup_capacity){
+		if((grown = realloc(crud_dedup_slots, ((crud_dedup_capacity) ? 2 * crud_dedup_capacity : 64) * sizeof(CrudDedupSlot))) == NULL)
+			return -1;
+		crud_dedup_slots = grown;
+		crud_dedup_capacity = (crud_dedup_capacity) ? 2 * crud_dedup_capacity : 64;
+	}
+	*slot = crud_dedup_used++;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : puts an entry in a slot of the dedup index, linked into both chains
+//IN: the slot, the entry
+//Out: none
+void linkDedupSlot(uint32_t slot, CrudDedupEntry *entry){
+uint32_t bucket;
+
+	crud_dedup_slots[slot].entry = *entry;
+	memcpy(&bucket, entry->hash, sizeof(bucket));
+	bucket &= CRUD_DEDUP_BUCKETS - 1;
+	crud_dedup_slots[slot].hash_next = crud_dedup_hash_buckets[bucket];
+	crud_dedup_hash_buckets[bucket] = slot;
+	bucket = entry->oid & (CRUD_DEDUP_BUCKETS - 1);
+	crud_dedup_slots[slot].oid_next = crud_dedup_oid_buckets[bucket];
+	crud_dedup_oid_buckets[bucket] = slot;
+	crud_dedup_count++;
+	markDedupDirty(slot);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds an entry to the dedup index (a full index just leaves the
+//           object out, it is then never shared)
+//IN: the entry
+//Out: 0 if successful, -1 if failure
+int addDedupEntry(CrudDedupEntry *entry){
+uint32_t slot;
+
+	//reuse a free slot, or take the next one while the index object has room
+	if(crud_dedup_free != CRUD_NO_SLOT){
+		slot = crud_dedup_free;
+		crud_dedup_free = crud_dedup_slots[slot].hash_next;
+	}
+	else{
+		if(crud_dedup_used >= CRUD_MAX_DEDUP_ENTRIES)
+			return 0;
+		if(takeDedupSlot(&slot) != 0)
+			return -1;
+	}
+	linkDedupSlot(slot, entry);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : removes an entry from the dedup index
+//IN: the slot of the entry
+//Out: none
+void removeDedupEntry(uint32_t slot){
+CrudDedupEntry *entry = &crud_dedup_slots[slot].entry;
+uint32_t *link, bucket;
+
+	memcpy(&bucket, entry->hash, sizeof(bucket));
+	for(link = &crud_dedup_hash_buckets[bucket & (CRUD_DEDUP_BUCKETS - 1)]; *link != slot; link = &crud_dedup_slots[*link].hash_next);
+	*link = crud_dedup_slots[slot].hash_next;
+	for(link = &crud_dedup_oid_buckets[entry->oid & (CRUD_DEDUP_BUCKETS - 1)]; *link != slot; link = &crud_dedup_slots[*link].oid_next);
+	*link = crud_dedup_slots[slot].oid_next;
+
+	memset(entry, 0, sizeof(CrudDedupEntry));
+	crud_dedup_slots[slot].hash_next = crud_dedup_free;
+	crud_dedup_free = slot;
+	crud_dedup_count--;
+	markDedupDirty(slot);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : drops the in-memory dedup index so it is read again on first use
+//IN: none
+//Out: none
+void resetDedupIndex(void){
+uint32_t i;
+
+	free(crud_dedup_slots);
+	crud_dedup_slots = NULL;
+	crud_dedup_capacity = crud_dedup_used = crud_dedup_count = 0;
+	crud_dedup_free = CRUD_NO_SLOT;
+	for(i = 0; i < CRUD_DEDUP_BUCKETS; i++)
+		crud_dedup_hash_buckets[i] = crud_dedup_oid_buckets[i] = CRUD_NO_SLOT;
+	crud_dedup_loaded = 0;
+	crud_dedup_dirty_lo = 1;
+	crud_dedup_dirty_hi = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads the dedup index object into memory (if not already)
+//IN: none
+//Out: 0 if successful, -1 if failure
+int loadDedupIndex(void){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+CrudDedupEntry *temp;
+uint32_t i, slot;
+
+	if(crud_dedup_loaded)
+		return 0;
+
+	resetDedupIndex();
+	if(crud_table_root.dedup_index != CRUD_NO_OBJECT){
+		if((temp = malloc(crud_table_root.dedup_entries * sizeof(CrudDedupEntry))) == NULL)
+			return -1;
+		request = construct_crud_request(crud_table_root.dedup_index, CRUD_READ,
+				crud_table_root.dedup_entries * sizeof(CrudDedupEntry), 0,0);
+		response = crud_client_operation(request,temp);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0){
+			free(temp);
+			return -1;
+		}
+
+		//the slots are laid out as in the object, so it can be written back in place
+		for(i = 0; i < crud_table_root.dedup_entries; i++){
+			if(takeDedupSlot(&slot) != 0){
+				free(temp);
+				resetDedupIndex();
+				return -1;
+			}
+			if(temp[i].oid != CRUD_NO_OBJECT)
+				linkDedupSlot(slot, &temp[i]);
+			else{
+				crud_dedup_slots[slot].entry = temp[i];
+				crud_dedup_slots[slot].hash_next = crud_dedup_free;
+				crud_dedup_free = slot;
+			}
+		}
+		free(temp);
+	}
+
+	crud_dedup_loaded = 1;
+	crud_dedup_dirty_lo = 1;
+	crud_dedup_dirty_hi = 0;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes the dedup index back to its object (if changed)
+//IN: none
+//Out: 0 if successful, -1 if failure
+int flushDedupIndex(void){
+CrudDedupEntry *temp;
+uint32_t i;
+int result;
+
+	if(!crud_dedup_loaded || (crud_dedup_dirty_lo > crud_dedup_dirty_hi && crud_table_root.dedup_entries == crud_dedup_used))
+		return 0;
+
+	//the object lays the slots out in order (an unused one has no OID)
+	if((temp = malloc((crud_dedup_used) ? crud_dedup_used * sizeof(CrudDedupEntry) : 1)) == NULL)
+		return -1;
+	for(i = 0; i < crud_dedup_used; i++)
+		temp[i] = crud_dedup_slots[i].entry;
+	result = writeIndexObject(&crud_table_root.dedup_index, &crud_table_root.dedup_entries, (char *)temp,
+			sizeof(CrudDedupEntry), crud_dedup_used, crud_dedup_dirty_lo, crud_dedup_dirty_hi);
+	free(temp);
+	if(result != 0)
+		return -1;
+	crud_dedup_dirty_lo = 1;
+	crud_dedup_dirty_hi = 0;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gets the checksum shard an object is in
+//IN: the object ID
+//Out: the shard number
+uint32_t checksumShard(CrudOID oid){
+
+	return oid & (CRUD_CHECKSUM_SHARDS - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gets the slot an object would be in if it had no neighbours (the
+//           OIDs of a shard share their low bits, so only the rest are hashed)
+//IN: the shard and the object ID
+//Out: the slot (the shard must have slots)
+uint32_t checksumHome(CrudChecksumShard *shard, CrudOID oid){
+
+	return ((oid / CRUD_CHECKSUM_SHARDS) * 2654435761u) & (shard->capacity - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finds the slot of an object in its checksum shard, or the unused
+//           slot it would go in
+//IN: the shard and the object ID
+//Out: the slot (the shard must have slots)
+uint32_t checksumSlot(CrudChecksumShard *shard, CrudOID oid){
+uint32_t mask = shard->capacity - 1;
+uint32_t slot = checksumHome(shard, oid);
+
+	while(shard->slots[slot] != CRUD_NO_SLOT && shard->entries[shard->slots[slot]].oid != oid)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finds the entry of an object in its checksum shard
+//IN: the shard and the object ID
+//Out: the entry, CRUD_NO_SLOT if the object has no checksum
+uint32_t findChecksum(CrudChecksumShard *shard, CrudOID oid){
+
+	if(shard->count == 0)
+		return CRUD_NO_SLOT;
+	return shard->slots[checksumSlot(shard, oid)];
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : marks an entry of a checksum shard as changed
+//IN: the shard and the entry
+//Out: none
+void markChecksumDirty(CrudChecksumShard *shard, uint32_t entry){
+
+	if(shard->dirty_lo > shard->dirty_hi)
+		shard->dirty_lo = shard->dirty_hi = entry;
+	else if(entry < shard->dirty_lo)
+		shard->dirty_lo = entry;
+	else if(entry > shard->dirty_hi)
+		shard->dirty_hi = entry;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : drops a checksum shard from memory (read again on next use)
+//IN: the shard
+//Out: none
+void resetChecksumShard(CrudChecksumShard *shard){
+
+	free(shard->entries);
+	free(shard->slots);
+	memset(shard, 0, sizeof(CrudChecksumShard));
+	shard->dirty_lo = 1;
+	shard->dirty_hi = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : drops the in-memory checksum index, it is not used until the
+//           next mount or format
+//IN: none
+//Out: none
+void resetChecksums(void){
+uint32_t i;
+
+	for(i = 0; i < CRUD_CHECKSUM_SHARDS; i++)
+		resetChecksumShard(&crud_checksum_shards[i]);
+	crud_checksums_open = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : starts using the checksum index of the mounted table (its shards
+//           are read as they are needed)
+//IN: none
+//Out: none
+void openChecksums(void){
+
+	resetChecksums();
+	crud_checksums_open = 1;
+
+	//a ranged read is part of an object, which has one checksum for all of it
+	if(crud_network_extensions)
+		logMessage(LOG_WARNING_LEVEL, "CRUD IO : ranged reads of chunk and slab objects are not checked against their checksums");
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : doubles the slots of a checksum shard, pointing them at the entries again
+//IN: the shard
+//Out: 0 if successful, -1 if failure
+int growChecksumSlots(CrudChecksumShard *shard){
+uint32_t *grown, capacity, i;
+
+	capacity = (shard->capacity) ? 2 * shard->capacity : 64;
+	if((grown = malloc(capacity * sizeof(uint32_t))) == NULL)
+		return -1;
+	for(i = 0; i < capacity; i++)
+		grown[i] = CRUD_NO_SLOT;
+	free(shard->slots);
+	shard->slots = grown;
+	shard->capacity = capacity;
+	for(i = 0; i < shard->count; i++)
+		shard->slots[checksumSlot(shard, shard->entries[i].oid)] = i;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads a checksum shard object into memory (if not already)
+//IN: the shard number
+//Out: 0 if successful, -1 if failure
+int loadChecksumShard(uint32_t idx){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+CrudChecksumShard *shard = &crud_checksum_shards[idx];
+CrudIndexRef *ref = &crud_table_root.checksum_shards[idx];
+
+	if(shard->loaded)
+		return 0;
+	if(ref->oid != CRUD_NO_OBJECT){
+		//the entries stay as laid out in the object, the slots are built over them
+		if((shard->entries = malloc(ref->count * sizeof(CrudChecksum))) == NULL)
+			return -1;
+		shard->room = ref->count;
+		request = construct_crud_request(ref->oid, CRUD_READ, ref->count * sizeof(CrudChecksum), 0,0);
+		response = crud_client_operation(request,shard->entries);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0){
+			resetChecksumShard(shard);
+			return -1;
+		}
+		shard->count = ref->count;
+		while(shard->capacity < 2 * shard->count){
+			if(growChecksumSlots(shard) != 0){
+				resetChecksumShard(shard);
+				return -1;
+			}
+		}
+	}
+	shard->loaded = 1;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gets the shard of an object to change, one that cannot be read
+//           is started over empty (its objects are no longer checked, rather
+//           than being checked against checksums that are out of date)
+//IN: the object ID
+//Out: the shard
+CrudChecksumShard *changeChecksumShard(CrudOID oid){
+uint32_t idx = checksumShard(oid);
+
+	if(loadChecksumShard(idx) != 0){
+		logMessage(LOG_ERROR_LEVEL, "CRUD IO : checksum shard %u unreadable, starting it over", idx);
+		crud_checksum_shards[idx].loaded = 1;
+	}
+	return &crud_checksum_shards[idx];
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : records a checksum worked out already, growing the shard as
+//           needed (a new object is left out once the shard object is full)
+//IN: the object ID, the checksum of its contents
+//Out: none
+void putChecksum(CrudOID oid, uint32_t crc){
+CrudChecksumShard *shard = changeChecksumShard(oid);
+CrudChecksum *grown;
+uint32_t entry, room;
+
+	//an object already in the index just gets its new checksum
+	if((entry = findChecksum(shard, oid)) != CRUD_NO_SLOT){
+		shard->entries[entry].crc = crc;
+		markChecksumDirty(shard, entry);
+		return;
+	}
+	if(shard->count >= CRUD_MAX_SHARD_CHECKSUMS){
+		if(!shard->full)
+			logMessage(LOG_WARNING_LEVEL, "CRUD IO : checksum shard %u is full, objects added to it are not checked", checksumShard(oid));
+		shard->full = 1;
+		return;
+	}
+
+	//keep the slots at most half full, new entries go on the end
+	if(2 * (shard->count + 1) > shard->capacity && growChecksumSlots(shard) != 0)
+		return;
+	if(shard->count == shard->room){
+		room = (shard->room) ? 2 * shard->room : 32;
+		if((grown = realloc(shard->entries, room * sizeof(CrudChecksum))) == NULL)
+			return;
+		shard->entries = grown;
+		shard->room = room;
+	}
+	entry = shard->count++;
+	shard->entries[entry].oid = oid;
+	shard->entries[entry].crc = crc;
+	shard->slots[checksumSlot(shard, oid)] = entry;
+	markChecksumDirty(shard, entry);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : forgets the checksum of an object (if it has one)
+//IN: the object ID
+//Out: none
+void forgetChecksum(CrudOID oid){
+CrudChecksumShard *shard = changeChecksumShard(oid);
+uint32_t entry, slot, next, home, mask;
+
+	//close the gap in the slots so later ones stay reachable
+	if((entry = findChecksum(shard, oid)) == CRUD_NO_SLOT)
+		return;
+	slot = checksumSlot(shard, oid);
+	mask = shard->capacity - 1;
+	for(next = (slot + 1) & mask; shard->slots[next] != CRUD_NO_SLOT; next = (next + 1) & mask){
+		home = checksumHome(shard, shard->entries[shard->slots[next]].oid);
+		if(((next - home) & mask) >= ((next - slot) & mask)){
+			shard->slots[slot] = shard->slots[next];
+			slot = next;
+		}
+	}
+	shard->slots[slot] = CRUD_NO_SLOT;
+
+	//the last entry takes its place, so the entries stay one after the other
+	if(entry != --shard->count){
+		shard->entries[entry] = shard->entries[shard->count];
+		shard->slots[checksumSlot(shard, shard->entries[entry].oid)] = entry;
+		markChecksumDirty(shard, entry);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : records the checksum of the contents of an object, or forgets it
+//           (contents not known, or object gone); an object with no checksum
+//           is not checked
+//IN: the object ID, its contents (NULL to forget) and their length
+//Out: none
+void setChecksum(CrudOID oid, char *data, uint32_t length){
+uint32_t crc;
+
+	if(!crud_checksums_open || oid == CRUD_NO_OBJECT)
+		return;
+	if(data != NULL){
+		crc = checksum_crud_buffer(data, length);
+		pthread_mutex_lock(&crud_checksum_lock);
+		putChecksum(oid, crc);
+	}
+	else{
+		pthread_mutex_lock(&crud_checksum_lock);
+		forgetChecksum(oid);
+	}
+	pthread_mutex_unlock(&crud_checksum_lock);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gives a copy of an object the checksum of the original (if it has one)
+//IN: the object ID, the ID of the copy
+//Out: none
+void copyChecksum(CrudOID oid, CrudOID copy){
+CrudChecksumShard *shard;
+uint32_t entry;
+
+	if(!crud_checksums_open || copy == CRUD_NO_OBJECT)
+		return;
+	pthread_mutex_lock(&crud_checksum_lock);
+	shard = changeChecksumShard(oid);
+	if((entry = findChecksum(shard, oid)) != CRUD_NO_SLOT)
+		putChecksum(copy, shard->entries[entry].crc);
+	pthread_mutex_unlock(&crud_checksum_lock);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : checks the contents of an object read from the server against
+//           its checksum (if it has one), reading its shard in if needed
+//IN: the object ID, its contents and their length
+//Out: 0 if they match (or there is no checksum), -1 if not (or the shard is unreadable)
+int verifyChecksum(CrudOID oid, char *data, uint32_t length){
+CrudChecksumShard *shard = &crud_checksum_shards[checksumShard(oid)];
+uint32_t entry, crc, expected = 0;
+int found = 0;
+
+	if(!crud_checksums_open)
+		return 0;
+	pthread_mutex_lock(&crud_checksum_lock);
+	if(loadChecksumShard(checksumShard(oid)) != 0){
+		pthread_mutex_unlock(&crud_checksum_lock);
+		logMessage(LOG_ERROR_LEVEL, "CRUD IO : checksum shard %u unreadable checking object %u", checksumShard(oid), oid);
+		return -1;
+	}
+	if((entry = findChecksum(shard, oid)) != CRUD_NO_SLOT){
+		expected = shard->entries[entry].crc;
+		found = 1;
+	}
+	pthread_mutex_unlock(&crud_checksum_lock);
+
+	if(found && (crc = checksum_crud_buffer(data, length)) != expected){
+		logMessage(LOG_ERROR_LEVEL, "CRUD IO : checksum mismatch on object %u [%08x != %08x]", oid, crc, expected);
+		return -1;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes the checksum shards that changed back to their objects
+//IN: none
+//Out: 0 if successful, -1 if failure
+int flushChecksums(void){
+CrudChecksumShard *shard;
+CrudIndexRef *ref;
+uint32_t i;
+
+	for(i = 0; i < CRUD_CHECKSUM_SHARDS; i++){
+		shard = &crud_checksum_shards[i];
+		ref = &crud_table_root.checksum_shards[i];
+		if(!shard->loaded || (shard->dirty_lo > shard->dirty_hi && ref->count == shard->count))
+			continue;
+		if(writeIndexObject(&ref->oid, &ref->count, (char *)shard->entries, sizeof(CrudChecksum),
+				shard->count, shard->dirty_lo, shard->dirty_hi) != 0)
+			return -1;
+		shard->dirty_lo = 1;
+		shard->dirty_hi = 0;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : drops the in-memory name filter (read again at mount)
+//IN: none
+//Out: none
+void resetNameFilter(void){
+
+	free(crud_name_filter);
+	crud_name_filter = NULL;
+	crud_name_filter_length = 0;
+	crud_name_filter_lo = 1;
+	crud_name_filter_hi = 0;
+	crud_name_filter_new = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : sets the bits of a path in the name filter (it must have one)
+//IN: the path
+//Out: none
+void setNameFilterBits(char *path){
+uint32_t hash = pathHash(path);
+uint32_t step = checksum_crud_buffer(path, strlen(path)) | 1;
+uint32_t mask = crud_name_filter_length * 8 - 1;
+uint32_t i, bit;
+
+	//the bits are hash + i*step (two independent hashes make the rest)
+	for(i = 0; i < CRUD_NAME_FILTER_HASHES; i++, hash += step){
+		bit = hash & mask;
+		if(crud_name_filter[bit / 8] & (1u << (bit % 8)))
+			continue;
+		crud_name_filter[bit / 8] |= 1u << (bit % 8);
+		if(crud_name_filter_lo > crud_name_filter_hi)
+			crud_name_filter_lo = crud_name_filter_hi = bit / 8;
+		else if(bit / 8 < crud_name_filter_lo)
+			crud_name_filter_lo = bit / 8;
+		else if(bit / 8 > crud_name_filter_hi)
+			crud_name_filter_hi = bit / 8;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : checks if a path may be in the table (the name filter must exist)
+//IN: the path
+//Out: 1 if it may be, 0 if it is not
+int inNameFilter(char *path){
+uint32_t hash = pathHash(path);
+uint32_t step = checksum_crud_buffer(path, strlen(path)) | 1;
+uint32_t mask = crud_name_filter_length * 8 - 1;
+uint32_t i, bit;
+
+	for(i = 0; i < CRUD_NAME_FILTER_HASHES; i++, hash += step){
+		bit = hash & mask;
+		if(!(crud_name_filter[bit / 8] & (1u << (bit % 8))))
+			return 0;
+	}
+	return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : builds the name filter from every path in the table (reading in
+//           the pages), sized for twice the files there are
+//IN: none
+//Out: 0 if successful, -1 if failure
+int buildNameFilter(void){
+uint32_t length = CRUD_MIN_NAME_FILTER_LENGTH;
+uint32_t i;
+
+	for(i = 0; i < crud_table_root.pages; i++)
+		if(loadTablePage(i) != 0)
+			return -1;
+	while(length < CRUD_MAX_NAME_FILTER_LENGTH && 8 * length < 2 * CRUD_NAME_FILTER_BITS_PER_FILE * crud_table_root.files)
+		length *= 2;
+
+	resetNameFilter();
+	if((crud_name_filter = calloc(length, 1)) == NULL)
+		return -1;
+	crud_name_filter_length = length;
+	for(i = 0; i < crud_table_root.files; i++)
+		if(slotEntry(i)->filename[0] != '\0')
+			setNameFilterBits(slotEntry(i)->filename);
+
+	//the whole filter goes out to an object of its own
+	crud_name_filter_new = 1;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads the name filter object into memory, one that is out of date
+//           (or missing or unreadable) is left out until every page is read
+//IN: none
+//Out: 0 if successful, -1 if failure
+int loadNameFilter(void){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+	resetNameFilter();
+
+	//an empty table starts an empty filter
+	if(crud_table_root.files == 0)
+		return buildNameFilter();
+	if(crud_table_root.name_filter == CRUD_NO_OBJECT || crud_table_root.name_filter_files != crud_table_root.files)
+		return 0;
+
+	if((crud_name_filter = malloc(crud_table_root.name_filter_length)) == NULL)
+		return -1;
+	request = construct_crud_request(crud_table_root.name_filter, CRUD_READ, crud_table_root.name_filter_length, 0,0);
+	response = crud_client_operation(request,crud_name_filter);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0 || (uint32_t)length != crud_table_root.name_filter_length){
+		resetNameFilter();
+		return 0;
+	}
+	crud_name_filter_length = length;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds the path of a new file to the name filter, rebuilding it
+//           twice the size when it gets too full
+//IN: the path
+//Out: 0 if successful, -1 if failure
+int addNameFilter(char *path){
+
+	if(crud_name_filter == NULL)
+		return 0;
+	if(crud_name_filter_length < CRUD_MAX_NAME_FILTER_LENGTH &&
+			CRUD_NAME_FILTER_BITS_PER_FILE * crud_table_root.files > 8 * crud_name_filter_length)
+		return buildNameFilter();
+	setNameFilterBits(path);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes the name filter back to its object (if changed), with the
+//           ranged request extension only the bytes that changed go out
+//IN: none
+//Out: 0 if successful, -1 if failure
+int flushNameFilter(void){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+CrudOID oldFilter = crud_table_root.name_filter;
+
+	if(crud_name_filter == NULL)
+		return 0;
+
+	//a new or resized filter replaces the object
+	if(crud_name_filter_new || oldFilter == CRUD_NO_OBJECT){
+		request = construct_crud_request(0, CRUD_CREATE, crud_name_filter_length, 0,0);
+		response = crud_client_operation(request,crud_name_filter);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0)
+			return -1;
+		crud_table_root.name_filter = ID;
+		crud_table_root.name_filter_length = crud_name_filter_length;
+		crud_table_root_dirty = 1;
+		if(oldFilter != CRUD_NO_OBJECT){
+			request = construct_crud_request(oldFilter, CRUD_DELETE, 0, 0,0);
+			response = crud_client_operation(request,NULL);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+		}
+	}
+	else if(crud_name_filter_lo <= crud_name_filter_hi){
+		if(crud_network_extensions){
+			if(writeRange(oldFilter, crud_name_filter_lo, crud_name_filter_hi - crud_name_filter_lo + 1,
+					&crud_name_filter[crud_name_filter_lo]) != 0)
+				return -1;
+		}
+		else{
+			request = construct_crud_request(oldFilter, CRUD_UPDATE, crud_name_filter_length, 0,0);
+			response = crud_client_operation(request,crud_name_filter);
+			decryptResponse(response,&ID,&length, &result);
+			if(result != 0)
+				return -1;
+		}
+	}
+	crud_name_filter_lo = 1;
+	crud_name_filter_hi = 0;
+	crud_name_filter_new = 0;
+
+	//the filter holds every path up to here
+	if(crud_table_root.name_filter_files != crud_table_root.files){
+		crud_table_root.name_filter_files = crud_table_root.files;
+		crud_table_root_dirty = 1;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : looks up the object holding a chunk of a file
+//IN: file descriptor, chunk index, place to put the OID
+//Out: 0 if successful, -1 if failure
+int getChunk(int16_t fd, uint32_t idx, CrudOID *oid){
+
+	if(idx < CRUD_DIRECT_CHUNKS){
+		*oid = fileEntry(fd)->chunks[idx];
+		return 0;
+	}
+
+	if(loadExtentMap(fd) != 0)
+		return -1;
+	idx -= CRUD_DIRECT_CHUNKS;
+	*oid = (idx < crud_extent_maps[fd].count) ? crud_extent_maps[fd].chunks[idx] : CRUD_NO_OBJECT;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : records the object holding a chunk of a file
+//IN: file descriptor, chunk index, OID
+//Out: 0 if successful, -1 if failure
+int setChunk(int16_t fd, uint32_t idx, CrudOID oid){
+CrudExtentMap *map = &crud_extent_maps[fd];
+CrudOID *grown;
+
+	if(idx < CRUD_DIRECT_CHUNKS){
+		fileEntry(fd)->chunks[idx] = oid;
+		markFileDirty(fd);
+		return 0;
+	}
+
+	if(loadExtentMap(fd) != 0)
+		return -1;
+	idx -= CRUD_DIRECT_CHUNKS;
+
+	//grow the map to cover the chunk, new entries are holes
+	if(idx >= map->count){
+		if((grown = realloc(map->chunks, (idx + 1) * sizeof(CrudOID))) == NULL)
+			return -1;
+		memset(&grown[map->count], 0, (idx + 1 - map->count) * sizeof(CrudOID));
+		map->chunks = grown;
+		map->count = idx + 1;
+	}
+	map->chunks[idx] = oid;
+	map->dirty = 1;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : checks if a file is held in its table entry (tiny and with no
+//           slab or chunk object)
+//IN: the file table entry
+//Out: 1 if the file is inline, 0 if not
+int inlineFile(CrudFileAllocationType *entry){
+	return (entry->length <= CRUD_MAX_INLINE_LENGTH && entry->slab == CRUD_NO_OBJECT &&
+		entry->chunks[0] == CRUD_NO_OBJECT) ? 1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : checks if the chunk objects of an open file are stored compressed
+//IN: file descriptor
+//Out: 1 if the file is compressed, 0 if not
+int compressedFile(int16_t fd){
+	return (fileEntry(fd)->flags & CRUD_FILE_COMPRESSED) ? 1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finds the object a chunk of a file is in; the chunk of a packed
+//           file is a range of its slab, any other chunk is an object itself
+//IN: file descriptor, chunk index, file length, places to put the OID, the
+//    size of the object and the position of the chunk in the object
+//Out: 0 if successful, -1 if failure
+int chunkObject(int16_t fd, uint32_t idx, uint32_t fileLength, CrudOID *oid, uint32_t *objLength, uint32_t *base){
+CrudFileAllocationType *entry = fileEntry(fd);
+
+	if(entry->slab != CRUD_NO_OBJECT){
+		*oid = entry->slab;
+		*objLength = CRUD_SLAB_SIZE;
+		*base = entry->slab_offset;
+		return 0;
+	}
+	*objLength = chunkCapacity(idx, fileLength);
+	*base = 0;
+	return getChunk(fd, idx, oid);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads bytes from one chunk of a file into the callers buffer
+//IN: the chunk OID and its length, flag for the chunk possibly being stored
+//    compressed (no ranged reads), the offset and count to read, the buffer
+//Out: 0 if successful, -1 if failure
+int readChunk(CrudOID oid, uint32_t objLength, int compressed, uint32_t offset, uint32_t count, char *buf){
+uint32_t cachedLength;
+char *data;
+
+	//holes read back as zeros
+	if(oid == CRUD_NO_OBJECT){
+		memset(buf, 0, count);
+		return 0;
+	}
+
+	//serve from the cache if we have the object, otherwise only transfer
+	//the requested bytes when the server supports ranged reads (a range is
+	//not checked, only a whole object read as one can be)
+	data = get_crud_cache(oid, &cachedLength);
+	if(data == NULL && crud_network_extensions && !compressed && (offset != 0 || count != objLength))
+		return (readRange(oid, offset, count, buf) == (int32_t)count) ? 0 : -1;
+
+	//the whole object is wanted, receive it straight into the callers buffer
+	if(data == NULL && offset == 0 && count == objLength)
+		return readObject(oid, objLength, buf);
+
+	//get the whole object contents
+	if(data == NULL && (data = fetchObject(oid, objLength)) == NULL)
+		return -1;
+	memcpy(buf, &data[offset], count);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes bytes into one chunk of a file, growing the chunk object
+//           from objLength to newLength (zero filled) as needed
+//IN: pointer to the chunk OID (updated if the object changes), the old and
+//    new sizes of the chunk object, the offset and count to write, the buffer
+//Out: 0 if successful, -1 if failure
+int writeChunk(CrudOID *oid, uint32_t objLength, uint32_t newLength, uint32_t offset, uint32_t count, char *buf){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+uint32_t inPlace = 0, cachedLength;
+char *data, *newBuf, *tail;
+
+	//no object yet (new chunk or a hole), create it zero filled around the data
+	if(*oid == CRUD_NO_OBJECT){
+		if((newBuf = alloc_crud_pool(newLength)) == NULL)
+			return -1;
+		memset(newBuf, 0, newLength);
+		memcpy(&newBuf[offset], buf, count);
+		request = construct_crud_request(0, CRUD_CREATE, newLength, 0,0);
+		response = crud_client_operation(request,newBuf);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0){
+			free_crud_pool(newBuf);
+			return -1;
+		}
+		*oid = ID;
+		setChecksum(ID, newBuf, newLength);
+		init_crud_cache();
+		adopt_crud_cache(ID, newBuf, newLength);
+		return 0;
+	}
+
+	//only ship the new bytes when the server supports ranged updates: the
+	//part inside the object is a ranged update, the rest is an append or a
+	//resize (the checksum is only known again if the object is cached)
+	if(crud_network_extensions){
+		setChecksum(*oid, NULL, 0);
+		if(offset < objLength)
+			inPlace = (offset + count > objLength) ? objLength - offset : count;
+		if(inPlace > 0 && writeRange(*oid, offset, inPlace, buf) != 0){
+			delete_crud_cache(*oid);
+			return -1;
+		}
+
+		//growing by zeros only, the server fills them in
+		if(newLength > objLength && offset + count <= objLength && resizeObject(*oid, newLength) != 0){
+			delete_crud_cache(*oid);
+			return -1;
+		}
+		else if(newLength > objLength && offset + count > objLength){
+			if(offset == objLength && offset + count == newLength)
+				tail = buf;
+			else{
+				if((tail = alloc_crud_pool(newLength - objLength)) == NULL){
+					delete_crud_cache(*oid);
+					return -1;
+				}
+				memset(tail, 0, newLength - objLength);
+				if(offset + count > objLength)
+					memcpy(&tail[offset + inPlace - objLength], &buf[inPlace], count - inPlace);
+			}
+			result = appendObject(*oid, newLength - objLength, tail);
+			if(tail != buf)
+				free_crud_pool(tail);
+			if(result != 0){
+				delete_crud_cache(*oid);
+				return -1;
+			}
+		}
+
+		patchCachedObject(*oid, objLength, newLength, offset, count, buf);
+		setChecksum(*oid, get_crud_cache(*oid, &cachedLength), newLength);
+		return 0;
+	}
+
+	//get the current contents (served from the cache when possible)
+	if((data = objectContents(*oid, objLength)) == NULL)
+		return -1;
+
+	//same size, update the cached copy in place and write it through
+	if(newLength == objLength){
+		memcpy(&data[offset], buf, count);
+		setChecksum(*oid, data, objLength);
+		request = construct_crud_request(*oid, CRUD_UPDATE, objLength, 0,0);
+		if(deferRequest(request, 0, data) == 0)
+			return 0;
+		response = crud_client_operation(request,data);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0){
+			setChecksum(*oid, NULL, 0);
+			delete_crud_cache(*oid);
+			return -1;
+		}
+		return 0;
+	}
+
+	//growing, create a bigger object and delete the old one
+	if((newBuf = alloc_crud_pool(newLength)) == NULL)
+		return -1;
+	memcpy(newBuf, data, objLength);
+	memset(&newBuf[objLength], 0, newLength - objLength);
+	memcpy(&newBuf[offset], buf, count);
+
+	request = construct_crud_request(0, CRUD_CREATE, newLength, 0,0);
+	response = crud_client_operation(request,newBuf);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0){
+		free_crud_pool(newBuf);
+		return -1;
+	}
+	CrudOID tempID = ID;
+
+	request = construct_crud_request(*oid, CRUD_DELETE, 0, 0,0);
+	response = crud_client_operation(request,NULL);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0){
+		free_crud_pool(newBuf);
+		return -1;
+	}
+
+	// Swap the cached copy (and the checksum) over to the new object
+	setChecksum(*oid, NULL, 0);
+	setChecksum(tempID, newBuf, newLength);
+	delete_crud_cache(*oid);
+	adopt_crud_cache(tempID, newBuf, newLength);
+	*oid = tempID;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes bytes into one compressed chunk of a file.  The compressed
+//           size changes with the contents, so the whole chunk is compressed
+//           into a new object (kept uncompressed if it does not shrink) and the
+//           old one is deleted; the cache holds the uncompressed contents.
+//IN: pointer to the chunk OID (updated), the old and new sizes of the chunk,
+//    the offset and count to write, the buffer
+//Out: 0 if successful, -1 if failure
+int writeCompressed(CrudOID *oid, uint32_t objLength, uint32_t newLength, uint32_t offset, uint32_t count, char *buf){
+CrudOID ID;
+int32_t length=0, packed;
+int result;
+CrudRequest request;
+CrudResponse response;
+char *data, *newBuf, *zbuf;
+
+	//build the new contents of the chunk
+	if((newBuf = alloc_crud_pool(newLength)) == NULL)
+		return -1;
+	memset(newBuf, 0, newLength);
+	if(*oid != CRUD_NO_OBJECT){
+		if((data = objectContents(*oid, objLength)) == NULL){
+			free_crud_pool(newBuf);
+			return -1;
+		}
+		memcpy(newBuf, data, objLength);
+	}
+	memcpy(&newBuf[offset], buf, count);
+
+	//compress it, and store whichever is smaller
+	if((zbuf = alloc_crud_pool(newLength)) == NULL){
+		free_crud_pool(newBuf);
+		return -1;
+	}
+	packed = compress_crud_buffer(newBuf, newLength, zbuf, newLength - 1);
+	if(packed > 0)
+		request = construct_crud_request(0, CRUD_CREATE, packed, CRUD_COMPRESSED_OBJECT,0);
+	else
+		request = construct_crud_request(0, CRUD_CREATE, newLength, 0,0);
+	response = crud_client_operation(request, (packed > 0) ? zbuf : newBuf);
+	free_crud_pool(zbuf);
+	decryptResponse(response,&ID,&length, &result);
+	if(result != 0){
+		free_crud_pool(newBuf);
+		return -1;
+	}
+
+	//drop the old object
+	if(*oid != CRUD_NO_OBJECT){
+		CrudOID tempID = ID;
+		request = construct_crud_request(*oid, CRUD_DELETE, 0, 0,0);
+		response = crud_client_operation(request,NULL);
+		decryptResponse(response,&ID,&length, &result);
+		if(result != 0){
+			free_crud_pool(newBuf);
+			return -1;
+		}
+		setChecksum(*oid, NULL, 0);
+		delete_crud_cache(*oid);
+		ID = tempID;
+	}
+
+	setChecksum(ID, newBuf, newLength);
+	init_crud_cache();
+	adopt_crud_cache(ID, newBuf, newLength);
+	*oid = ID;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : stores the contents of a new chunk of a file.  If an object with
+//           the same contents is in the dedup index (by hash) the chunk shares
+//           it, otherwise a new object is created and added to the index.
+//IN: file descriptor, place to put the chunk OID, the contents (a pool
+//    buffer, taken over) and their length
+//Out: 0 if successful, -1 if failure
+int storeChunk(int16_t fd, CrudOID *oid, char *data, uint32_t length){
+unsigned char hash[CRUD_DEDUP_HASH_LENGTH];
+uint32_t hashLength = CRUD_DEDUP_HASH_LENGTH, slot, cachedLength;
+uint32_t flags = fileEntry(fd)->flags & CRUD_FILE_COMPRESSED;
+CrudDedupEntry entry;
+CrudOID ID = CRUD_NO_OBJECT;
+int result;
+
+	if(generate_md5_signature((unsigned char *)data, length, hash, &hashLength) != 0){
+		free_crud_pool(data);
+		return -1;
+	}
+
+	//the same contents are stored already, share the object
+	if((slot = findDedupHash(hash, flags)) != CRUD_NO_SLOT){
+		crud_dedup_slots[slot].entry.refs++;
+		markDedupDirty(slot);
+		*oid = crud_dedup_slots[slot].entry.oid;
+		init_crud_cache();
+		if(get_crud_cache(*oid, &cachedLength) == NULL)
+			adopt_crud_cache(*oid, data, length);
+		else
+			free_crud_pool(data);
+		return 0;
+	}
+
+	//otherwise create the object, and index it
+	if(flags)
+		result = writeCompressed(&ID, 0, length, 0, length, data);
+	else
+		result = writeChunk(&ID, 0, length, 0, length, data);
+	free_crud_pool(data);
+	if(result != 0)
+		return -1;
+	memcpy(entry.hash, hash, CRUD_DEDUP_HASH_LENGTH);
+	entry.oid = ID;
+	entry.refs = 1;
+	entry.flags = flags;
+	*oid = ID;
+	return addDedupEntry(&entry);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes bytes into one chunk object of a file, compressed or not.
+//           A new chunk is stored through the dedup index.  An object other
+//           chunks share is never changed in place: the chunk gets new
+//           contents of its own (copy on write), stored the same way.
+//IN: file descriptor, then as writeChunk
+//Out: 0 if successful, -1 if failure
+int writeFileChunk(int16_t fd, CrudOID *oid, uint32_t objLength, uint32_t newLength, uint32_t offset, uint32_t count, char *buf){
+uint32_t slot = CRUD_NO_SLOT;
+CrudOID ID;
+char *data, *newBuf;
+
+	if(loadDedupIndex() != 0)
+		return -1;
+
+	//an object only this chunk uses is written as usual (its contents will
+	//no longer match the index)
+	if(*oid != CRUD_NO_OBJECT && ((slot = findDedupOid(*oid)) == CRUD_NO_SLOT || crud_dedup_slots[slot].entry.refs == 1)){
+		if(slot != CRUD_NO_SLOT)
+			removeDedupEntry(slot);
+		if(compressedFile(fd))
+			return writeCompressed(oid, objLength, newLength, offset, count, buf);
+		return writeChunk(oid, objLength, newLength, offset, count, buf);
+	}
+
+	//build the new contents of the chunk
+	if((newBuf = alloc_crud_pool(newLength)) == NULL)
+		return -1;
+	memset(newBuf, 0, newLength);
+	if(*oid != CRUD_NO_OBJECT){
+		if((data = objectContents(*oid, objLength)) == NULL){
+			free_crud_pool(newBuf);
+			return -1;
+		}
+		memcpy(newBuf, data, objLength);
+	}
+	memcpy(&newBuf[offset], buf, count);
+
+	//store them, the shared object loses this chunk
+	if(storeChunk(fd, &ID, newBuf, newLength) != 0)
+		return -1;
+	if(slot != CRUD_NO_SLOT){
+		crud_dedup_slots[slot].entry.refs--;
+		markDedupDirty(slot);
+	}
+	*oid = ID;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : lets go of the object holding a chunk of a file: a shared object
+//           loses a reference, any other object is deleted
+//IN: the chunk OID (0 for a hole)
+//Out: 0 if successful, -1 if failure
+int releaseChunk(CrudOID oid){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+uint32_t slot;
+
+	if(oid == CRUD_NO_OBJECT)
+		return 0;
+	if(loadDedupIndex() != 0)
+		return -1;
+
+	if((slot = findDedupOid(oid)) != CRUD_NO_SLOT){
+		markDedupDirty(slot);
+		if(--crud_dedup_slots[slot].entry.refs > 0)
+			return 0;
+		removeDedupEntry(slot);
+	}
+
+	request = construct_crud_request(oid, CRUD_DELETE, 0, 0,0);
+	response = crud_client_operation(request,NULL);
+	decryptResponse(response,&ID,&length, &result);
+	setChecksum(oid, NULL, 0);
+	delete_crud_cache(oid);
+	return (result != 0) ? -1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : shrinks the last chunk object of a file being truncated, keeping
+//           its first bytes and zeros after them.  An uncompressed object only
+//           this chunk uses is resized on the server (nothing is transferred),
+//           any other chunk gets new contents stored as a new chunk would be.
+//IN: file descriptor, pointer to the chunk OID (updated if the object
+//    changes), the old and new sizes of the chunk object, bytes to keep
+//Out: 0 if successful, -1 if failure
+int shrinkChunk(int16_t fd, CrudOID *oid, uint32_t objLength, uint32_t newLength, uint32_t keep){
+uint32_t slot, cachedLength;
+CrudOID ID, old;
+char *data, *newBuf;
+
+	if(loadDedupIndex() != 0)
+		return -1;
+	slot = findDedupOid(*oid);
+
+	//cut the object after the bytes kept, then zero fill it out to its size
+	if(crud_network_extensions && !compressedFile(fd) && (slot == CRUD_NO_SLOT || crud_dedup_slots[slot].entry.refs == 1)){
+		if(slot != CRUD_NO_SLOT)
+			removeDedupEntry(slot);
+		setChecksum(*oid, NULL, 0);
+		if(resizeObject(*oid, keep) != 0 || (newLength > keep && resizeObject(*oid, newLength) != 0)){
+			delete_crud_cache(*oid);
+			return -1;
+		}
+
+		//the cached copy goes the same way
+		if((data = get_crud_cache(*oid, &cachedLength)) != NULL){
+			if(newLength == objLength)
+				memset(&data[keep], 0, objLength - keep);
+			else if((newBuf = alloc_crud_pool(newLength)) == NULL)
+				delete_crud_cache(*oid);
+			else{
+				memcpy(newBuf, data, keep);
+				memset(&newBuf[keep], 0, newLength - keep);
+				adopt_crud_cache(*oid, newBuf, newLength);
+			}
+		}
+		setChecksum(*oid, get_crud_cache(*oid, &cachedLength), newLength);
+		return 0;
+	}
+
+	//build the new contents, store them and let go of the old object
+	if((newBuf = alloc_crud_pool(newLength)) == NULL)
+		return -1;
+	if((data = objectContents(*oid, objLength)) == NULL){
+		free_crud_pool(newBuf);
+		return -1;
+	}
+	memcpy(newBuf, data, keep);
+	memset(&newBuf[keep], 0, newLength - keep);
+	if(storeChunk(fd, &ID, newBuf, newLength) != 0)
+		return -1;
+	old = *oid;
+	*oid = ID;
+	return releaseChunk(old);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gives a clone of a file its own reference to a chunk object of the
+//           file.  An object in the dedup index is shared (copy on write), any
+//           other is copied on the server; without the extensions its contents
+//           are read once and indexed so the two files share it after all.
+//IN: file descriptor (of the file cloned), the chunk OID and the size of the
+//    object, place to put the OID of the clone's chunk
+//Out: 0 if successful, -1 if failure
+int cloneChunk(int16_t fd, CrudOID oid, uint32_t objLength, CrudOID *copy){
+unsigned char hash[CRUD_DEDUP_HASH_LENGTH];
+uint32_t hashLength = CRUD_DEDUP_HASH_LENGTH, slot;
+uint32_t flags = fileEntry(fd)->flags & CRUD_FILE_COMPRESSED;
+CrudDedupEntry entry;
+char *data, *newBuf;
+
+	if(loadDedupIndex() != 0)
+		return -1;
+
+	//an object in the index just gets another reference
+	if((slot = findDedupOid(oid)) != CRUD_NO_SLOT){
+		crud_dedup_slots[slot].entry.refs++;
+		markDedupDirty(slot);
+		*copy = oid;
+		return 0;
+	}
+	if(crud_network_extensions)
+		return copyObject(oid, copy);
+
+	//index the contents (they may be stored already, in another object)
+	if((data = objectContents(oid, objLength)) == NULL ||
+	   generate_md5_signature((unsigned char *)data, objLength, hash, &hashLength) != 0)
+		return -1;
+	if((slot = findDedupHash(hash, flags)) == CRUD_NO_SLOT){
+		memcpy(entry.hash, hash, CRUD_DEDUP_HASH_LENGTH);
+		entry.oid = oid;
+		entry.refs = 1;
+		entry.flags = flags;
+		if(addDedupEntry(&entry) != 0)
+			return -1;
+		slot = findDedupOid(oid);
+	}
+	if(slot != CRUD_NO_SLOT){
+		crud_dedup_slots[slot].entry.refs++;
+		markDedupDirty(slot);
+		*copy = crud_dedup_slots[slot].entry.oid;
+		return 0;
+	}
+
+	//the index is full, the clone gets a copy of its own
+	if((newBuf = alloc_crud_pool(objLength)) == NULL)
+		return -1;
+	memcpy(newBuf, data, objLength);
+	return storeChunk(fd, copy, newBuf, objLength);
+}
+//////////////////////////////////////////////////////////////////////////////////
+//Function : gives out room in the current slab for a small file, starting a
+//           new slab (zero filled) when the current one is full
+//IN: the number of bytes wanted, places to put the slab and the position
+//Out: 0 if successful, -1 if failure
+int packSlot(uint32_t capacity, CrudOID *slab, uint32_t *offset){
+CrudOID oid = CRUD_NO_OBJECT;
+
+	if(crud_table_root.slab == CRUD_NO_OBJECT || crud_table_root.slab_used + capacity > CRUD_SLAB_SIZE){
+		if(writeChunk(&oid, 0, CRUD_SLAB_SIZE, 0, 0, NULL) != 0)
+			return -1;
+		crud_table_root.slab = oid;
+		crud_table_root.slab_used = 0;
+	}
+	*slab = crud_table_root.slab;
+	*offset = crud_table_root.slab_used;
+	crud_table_root.slab_used += capacity;
+	crud_table_root_dirty = 1;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes bytes of a small file into its slab.  The file has room
+//           for chunkCapacity bytes there; if it outgrows that (or is new) its
+//           contents move to a new slot, the old one is not used again.
+//IN: file descriptor, position in the file, buffer and count, new length
+//Out: 0 if successful, -1 if failure
+int writePacked(int16_t fd, uint32_t pos, char *buf, uint32_t count, uint32_t newLength){
+CrudFileAllocationType *entry = fileEntry(fd);
+uint32_t fileLength = entry->length;
+uint32_t capacity = chunkCapacity(0, newLength);
+uint32_t offset;
+CrudOID slab;
+char *data;
+
+	//still fits in its slot, update the bytes in place
+	if(entry->slab != CRUD_NO_OBJECT && capacity == chunkCapacity(0, fileLength)){
+		slab = entry->slab;
+		if(writeChunk(&slab, CRUD_SLAB_SIZE, CRUD_SLAB_SIZE, entry->slab_offset + pos, count, buf) != 0)
+			return -1;
+	}
+	else{
+		//build the slot contents (zeros past the end of the file) and write them all
+		if((data = alloc_crud_pool(capacity)) == NULL)
+			return -1;
+		memset(data, 0, capacity);
+		if(fileLength > 0 && readChunk(entry->slab, CRUD_SLAB_SIZE, 0, entry->slab_offset, fileLength, data) != 0){
+			free_crud_pool(data);
+			return -1;
+		}
+		memcpy(&data[pos], buf, count);
+		if(packSlot(capacity, &slab, &offset) != 0 ||
+		   writeChunk(&slab, CRUD_SLAB_SIZE, CRUD_SLAB_SIZE, offset, capacity, data) != 0){
+			free_crud_pool(data);
+			return -1;
+		}
+		free_crud_pool(data);
+		entry->slab = slab;
+		entry->slab_offset = offset;
+	}
+
+	//the slab is shared, other files may have read it ahead before the write
+	dropObjectReadAhead(slab);
+
+	entry->length = newLength;
+	markFileDirty(fd);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : moves a packed file out of its slab into a chunk object of its own
+//IN: file descriptor
+//Out: 0 if successful, -1 if failure
+int unpackFile(int16_t fd){
+CrudFileAllocationType *entry = fileEntry(fd);
+uint32_t capacity = chunkCapacity(0, entry->length);
+CrudOID chunk = CRUD_NO_OBJECT;
+char *data;
+
+	if((data = alloc_crud_pool(capacity)) == NULL)
+		return -1;
+	if(readChunk(entry->slab, CRUD_SLAB_SIZE, 0, entry->slab_offset, capacity, data) != 0 ||
+	   writeFileChunk(fd, &chunk, 0, capacity, 0, capacity, data) != 0){
+		free_crud_pool(data);
+		return -1;
+	}
+	free_crud_pool(data);
+	entry->slab = CRUD_NO_OBJECT;
+	entry->slab_offset = 0;
+	return setChunk(fd, 0, chunk);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : posts reads of the chunks of a file that are not cached or already
+//           in flight, so their transfers overlap each other and the reader
+//IN: file descriptor, first and last chunk to read ahead
+//Out: none (chunks that cannot be posted are read when they are needed)
+void startReadAhead(int16_t fd, uint32_t first, uint32_t last){
+CrudReadAhead *ra = &crud_read_aheads[fd];
+CrudReadAheadChunk *rc;
+uint32_t fileLength = fileEntry(fd)->length;
+uint32_t idx, i, cachedLength, objLength, base;
+CrudOID chunk;
+
+	for(idx = first; idx <= last && ra->count < CRUD_READ_AHEAD_CHUNKS; idx++){
+		for(i = 0; i < ra->count && ra->chunks[i].idx != idx; i++);
+		if(i < ra->count)
+			continue;
+
+		//holes and cached chunks need no transfer (a packed file brings in its whole slab)
+		if(chunkObject(fd, idx, fileLength, &chunk, &objLength, &base) != 0)
+			return;
+		if(chunk == CRUD_NO_OBJECT || get_crud_cache(chunk, &cachedLength) != NULL)
+			continue;
+
+		rc = &ra->chunks[ra->count];
+		rc->idx = idx;
+		rc->oid = chunk;
+		rc->length = objLength;
+		if((rc->data = alloc_crud_pool(rc->length)) == NULL)
+			return;
+		rc->ticket = crud_client_post(construct_crud_request(chunk, CRUD_READ, rc->length, 0, 0), 0, rc->data);
+		if(rc->ticket == -1){
+			free_crud_pool(rc->data);
+			return;
+		}
+		ra->count++;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : waits for the read ahead of a chunk (if there is one) and puts the
+//           chunk object in the cache for the reader
+//IN: file descriptor, chunk index
+//Out: none (a failed read ahead leaves the chunk to be read as usual)
+void awaitReadAhead(int16_t fd, uint32_t idx){
+CrudReadAhead *ra = &crud_read_aheads[fd];
+CrudReadAheadChunk *rc;
+CrudOID ID;
+int32_t length=0;
+int result;
+uint32_t i, cachedLength;
+CrudResponse response;
+char *data;
+
+	for(i = 0; i < ra->count && ra->chunks[i].idx != idx; i++);
+	if(i == ra->count)
+		return;
+	rc = &ra->chunks[i];
+
+	//a compressed chunk is cached as its contents
+	response = crud_client_complete(rc->ticket);
+	decryptResponse(response, &ID, &length, &result);
+	if(result == 0 && compressedResponse(response)){
+		data = inflateObject(rc->data, length, rc->length);
+		free_crud_pool(rc->data);
+		if((rc->data = data) == NULL)
+			result = 1;
+	}
+	if(result == 0 && verifyChecksum(rc->oid, rc->data, rc->length) != 0)
+		result = 1;
+	if(result == 0 && get_crud_cache(rc->oid, &cachedLength) == NULL){
+		init_crud_cache();
+		adopt_crud_cache(rc->oid, rc->data, rc->length);
+	}
+	else
+		free_crud_pool(rc->data);
+	*rc = ra->chunks[--ra->count];
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : throws away the read ahead of a file (the chunks may be about to
+//           change, or the reader went elsewhere)
+//IN: file descriptor
+//Out: none
+void dropReadAhead(int16_t fd){
+CrudReadAhead *ra = &crud_read_aheads[fd];
+
+	while(ra->count > 0){
+		ra->count--;
+		crud_client_complete(ra->chunks[ra->count].ticket);
+		free_crud_pool(ra->chunks[ra->count].data);
+	}
+	ra->next = CRUD_NO_POSITION;
+	ra->window = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : throws away the chunks read ahead from an object by any file (the
+//           object was written, the data read would be stale)
+//IN: the object
+//Out: none
+void dropObjectReadAhead(CrudOID oid){
+CrudReadAhead *ra;
+uint32_t i;
+
+	for(int16_t fd = 0; fd < CRUD_MAX_OPEN_FILES; fd++){
+		ra = &crud_read_aheads[fd];
+		for(i = 0; i < ra->count; ){
+			if(ra->chunks[i].oid != oid){
+				i++;
+				continue;
+			}
+			crud_client_complete(ra->chunks[i].ticket);
+			free_crud_pool(ra->chunks[i].data);
+			ra->chunks[i] = ra->chunks[--ra->count];
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes bytes of a file out to its chunk objects
+//IN: file descriptor, position in the file, buffer and count
+//Out: 0 if successful, -1 if failure
+int writeThrough(int16_t fd, uint32_t pos, char *buf, uint32_t count){
+CrudOID ID;
+uint32_t fileLength = fileEntry(fd)->length;
+uint32_t newLength, idx, off, last;
+uint32_t done = 0, n;
+CrudOID chunk;
+char *merged;
+int result;
+
+	//reads started before the write must not see it, and chunks read ahead
+	//would be stale after it
+	finishAsyncReads(fd);
+	dropReadAhead(fd);
+
+	newLength = (pos + count > fileLength) ? pos + count : fileLength;
+
+	//tiny files live in the table entry, one that grows out of it is written
+	//out whole (with this write merged in) as a new file would be
+	if(inlineFile(fileEntry(fd)) && (newLength <= CRUD_MAX_INLINE_LENGTH || fileLength > 0)){
+		if(newLength <= CRUD_MAX_INLINE_LENGTH){
+			memcpy(&fileEntry(fd)->contents[pos], buf, count);
+			fileEntry(fd)->length = newLength;
+			markFileDirty(fd);
+			return 0;
+		}
+		if((merged = alloc_crud_pool(newLength)) == NULL)
+			return -1;
+		memcpy(merged, fileEntry(fd)->contents, fileLength);
+		memset(&merged[fileLength], 0, newLength - fileLength);
+		memcpy(&merged[pos], buf, count);
+		memset(fileEntry(fd)->contents, 0, CRUD_MAX_INLINE_LENGTH);
+		fileEntry(fd)->length = 0;
+		result = writeThrough(fd, 0, merged, newLength);
+		free_crud_pool(merged);
+		return result;
+	}
+
+	//small files are packed into a slab, one that grows too big for that
+	//moves to a chunk object and carries on as any other file
+	if(fileEntry(fd)->slab != CRUD_NO_OBJECT || (fileLength == 0 && newLength > 0)){
+		if(newLength <= CRUD_MAX_PACKED_LENGTH)
+			return writePacked(fd, pos, buf, count, newLength);
+		if(fileEntry(fd)->slab != CRUD_NO_OBJECT && unpackFile(fd) != 0)
+			return -1;
+	}
+
+	//if the file grows and this write starts past the old last chunk (or is
+	//empty, a truncate growing the file), that chunk object still has to be
+	//filled out to its new size
+	if(fileLength > 0 && newLength > fileLength){
+		last = (fileLength - 1) / CRUD_CHUNK_SIZE;
+		if((count == 0 || last < pos / CRUD_CHUNK_SIZE) && chunkCapacity(last, newLength) > chunkCapacity(last, fileLength)){
+			if(getChunk(fd, last, &chunk) != 0)
+				return -1;
+			if(chunk != CRUD_NO_OBJECT){
+				if(writeFileChunk(fd, &chunk, chunkCapacity(last, fileLength), chunkCapacity(last, newLength),
+						chunkLength(last, fileLength), 0, NULL) != 0 || setChunk(fd, last, chunk) != 0)
+					return -1;
+			}
+		}
+	}
+
+	//write into each chunk the range covers (chunks in between stay holes)
+	while(done < count){
+		idx = (pos + done) / CRUD_CHUNK_SIZE;
+		off = (pos + done) % CRUD_CHUNK_SIZE;
+		n = (CRUD_CHUNK_SIZE - off < count - done) ? CRUD_CHUNK_SIZE - off : count - done;
+
+		if(getChunk(fd, idx, &chunk) != 0)
+			return -1;
+		ID = chunk;
+		if(writeFileChunk(fd, &chunk, chunkCapacity(idx, fileLength), chunkCapacity(idx, newLength), off, n, buf + done) != 0)
+			return -1;
+		if(chunk != ID && setChunk(fd, idx, chunk) != 0)
+			return -1;
+		done += n;
+	}
+
+	// Update file information
+	if(newLength != fileLength){
+		fileEntry(fd)->length = newLength;
+		markFileDirty(fd);
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes out the buffered writes of a file (if any), in chunk order
+//IN: file descriptor
+//Out: 0 if successful, -1 if failure
+int flushWriteBuffer(int16_t fd){
+CrudWriteBuffer *wb = &crud_write_buffers[fd];
+CrudWriteChunk *wc, swap;
+uint32_t i, j;
+
+	for(i = 0; i < wb->count; i++){
+		//pick the lowest chunk left
+		for(j = i + 1; j < wb->count; j++){
+			if(wb->chunks[j].idx < wb->chunks[i].idx){
+				swap = wb->chunks[i];
+				wb->chunks[i] = wb->chunks[j];
+				wb->chunks[j] = swap;
+			}
+		}
+		wc = &wb->chunks[i];
+		if(writeThrough(fd, wc->idx * CRUD_CHUNK_SIZE + wc->lo, &wc->data[wc->lo], wc->hi - wc->lo) != 0)
+			return -1;
+	}
+	wb->count = 0;
+	wb->end = 0;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : fills part of a buffered chunk with the current file contents
+//           (zeros past the end of the file)
+//IN: file descriptor, the buffered chunk, the range of the chunk to fill
+//Out: 0 if successful, -1 if failure
+int fillWriteChunk(int16_t fd, CrudWriteChunk *wc, uint32_t from, uint32_t to){
+uint32_t fileLength = fileEntry(fd)->length;
+uint32_t base = wc->idx * CRUD_CHUNK_SIZE;
+uint32_t stored = 0, objLength, objBase;
+CrudOID chunk;
+
+	if(fileLength > base + from)
+		stored = ((fileLength - base < to) ? fileLength - base : to) - from;
+	if(stored > 0 && inlineFile(fileEntry(fd)))
+		memcpy(&wc->data[from], &fileEntry(fd)->contents[from], stored);
+	else if(stored > 0 && (chunkObject(fd, wc->idx, fileLength, &chunk, &objLength, &objBase) != 0 ||
+			readChunk(chunk, objLength, compressedFile(fd), objBase + from, stored, &wc->data[from]) != 0))
+		return -1;
+	memset(&wc->data[from + stored], 0, to - from - stored);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds a write to the buffer of a file.  Writes to a chunk that is
+//           already buffered are merged into it (filling any gap from the
+//           file), the buffer is flushed when it has no room for a new chunk.
+//IN: file descriptor, position in the file, buffer and count
+//Out: 0 if successful, -1 if failure
+int bufferWrite(int16_t fd, uint32_t pos, char *buf, uint32_t count){
+CrudWriteBuffer *wb = &crud_write_buffers[fd];
+CrudWriteChunk *wc;
+uint32_t done = 0, idx, off, n, i;
+
+	//too big to buffer, write it straight out
+	if(count >= CRUD_WRITE_BUFFER_CHUNKS * CRUD_CHUNK_SIZE){
+		if(flushWriteBuffer(fd) != 0)
+			return -1;
+		return writeThrough(fd, pos, buf, count);
+	}
+
+	while(done < count){
+		idx = (pos + done) / CRUD_CHUNK_SIZE;
+		off = (pos + done) % CRUD_CHUNK_SIZE;
+		n = (CRUD_CHUNK_SIZE - off < count - done) ? CRUD_CHUNK_SIZE - off : count - done;
+
+		//find the chunk in the buffer, or start buffering it
+		for(i = 0; i < wb->count && wb->chunks[i].idx != idx; i++);
+		if(i == wb->count){
+			if(wb->count == CRUD_WRITE_BUFFER_CHUNKS && flushWriteBuffer(fd) != 0)
+				return -1;
+			i = wb->count++;
+			wc = &wb->chunks[i];
+			if(wc->data == NULL && (wc->data = malloc(CRUD_CHUNK_SIZE)) == NULL){
+				wb->count--;
+				return -1;
+			}
+			wc->idx = idx;
+			wc->lo = off;
+			wc->hi = off;
+		}
+		wc = &wb->chunks[i];
+
+		//fill the gap between the buffered bytes and the write
+		if(off > wc->hi && fillWriteChunk(fd, wc, wc->hi, off) != 0)
+			return -1;
+		if(off + n < wc->lo && fillWriteChunk(fd, wc, off + n, wc->lo) != 0)
+			return -1;
+		memcpy(&wc->data[off], buf + done, n);
+		if(off < wc->lo)
+			wc->lo = off;
+		if(off + n > wc->hi)
+			wc->hi = off + n;
+		if(idx * CRUD_CHUNK_SIZE + wc->hi > wb->end)
+			wb->end = idx * CRUD_CHUNK_SIZE + wc->hi;
+		done += n;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : starts a read of a file: writes out the buffered writes it would
+//           see, works out how much there is to read and posts the reads of
+//           its chunks (with the read ahead window past them)
+//IN: file descriptor, position, count, place to put the number of bytes to
+//    read, flag to post the chunks even when the read is within one chunk
+//Out: 0 if successful, -1 if failure
+int startRead(int16_t fd, uint32_t pos, int32_t count, int32_t *amtRead, int post){
+CrudReadAhead *ra = &crud_read_aheads[fd];
+uint32_t fileLength, last;
+
+	//buffered writes that grow the file or fall in the range have to go out first
+	CrudWriteBuffer *wb = &crud_write_buffers[fd];
+	for(uint32_t i = 0; i < wb->count; i++){
+		if(wb->end > fileEntry(fd)->length || (count > 0 && wb->chunks[i].idx >= pos / CRUD_CHUNK_SIZE &&
+		   wb->chunks[i].idx <= (pos + count - 1) / CRUD_CHUNK_SIZE)){
+			if(flushWriteBuffer(fd) != 0)
+				return -1;
+			break;
+		}
+	}
+	fileLength = fileEntry(fd)->length;
+	
+	if(fileLength == 0)//check to see if the file has any data
+		return -1;
+
+	// determine the amount read to the passed buffer
+	if(pos >= fileLength)
+		*amtRead = 0;
+	else if(count > fileLength - pos)
+		*amtRead = fileLength - pos;
+	else
+		*amtRead = count;
+
+	//a read that picks up where the last one ended grows the read ahead
+	//window, any other read throws the read ahead away
+	if(pos == ra->next)
+		ra->window = (ra->window == 0) ? 1 : (2 * ra->window < CRUD_READ_AHEAD_MAX_WINDOW) ? 2 * ra->window : CRUD_READ_AHEAD_MAX_WINDOW;
+	else
+		dropReadAhead(fd);
+	ra->next = pos + *amtRead;
+
+	//post the chunks of this read and the window past it together
+	if(*amtRead > 0){
+		last = (pos + *amtRead - 1) / CRUD_CHUNK_SIZE + ra->window;
+		if(last > (fileLength - 1) / CRUD_CHUNK_SIZE)
+			last = (fileLength - 1) / CRUD_CHUNK_SIZE;
+		if(post || last > pos / CRUD_CHUNK_SIZE)
+			startReadAhead(fd, pos / CRUD_CHUNK_SIZE, last);
+	}
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finishes a read of a file, copying each chunk the range covers
+//           into the callers buffer (waiting for the chunks posted for it)
+//IN: file descriptor, position, number of bytes to read, buffer
+//Out: 0 if successful, -1 if failure
+int finishRead(int16_t fd, uint32_t pos, int32_t amtRead, char *buf){
+uint32_t fileLength = fileEntry(fd)->length;
+int32_t done = 0, n;
+uint32_t idx, off, objLength, base;
+CrudOID chunk;
+
+	//a tiny file is right there in the table
+	if(inlineFile(fileEntry(fd))){
+		memcpy(buf, &fileEntry(fd)->contents[pos], amtRead);
+		return 0;
+	}
+
+	//read from each chunk the range covers
+	while(done < amtRead){
+		idx = (pos + done) / CRUD_CHUNK_SIZE;
+		off = (pos + done) % CRUD_CHUNK_SIZE;
+		n = (CRUD_CHUNK_SIZE - off < amtRead - done) ? CRUD_CHUNK_SIZE - off : amtRead - done;
+
+		awaitReadAhead(fd, idx);
+		if(chunkObject(fd, idx, fileLength, &chunk, &objLength, &base) != 0 ||
+		   readChunk(chunk, objLength, compressedFile(fd), base + off, n, buf + done) != 0)
+			return -1;
+		done += n;
+	}
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : posts an update for the asynchronous operation being started
+//           instead of waiting for it, the response is collected when the
+//           operation finishes
+//IN: the request, the range offset and the buffer (sent right away)
+//Out: 0 if posted, -1 if the caller has to send it itself
+int deferRequest(CrudRequest request, uint32_t offset, void *buf){
+CrudAsyncOp *op = crud_async_deferring;
+int ticket;
+
+	if(op == NULL || op->posted == CRUD_ASYNC_OP_TICKETS)
+		return -1;
+	if((ticket = crud_client_post(request, offset, buf)) == -1)
+		return -1;
+	op->tickets[op->posted++] = ticket;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : takes a free completion handle for an asynchronous operation
+//IN: the type of operation, file descriptor
+//Out: the completion handle, -1 if none are free
+CrudCompletion startAsyncOp(CRUD_ASYNC_TYPE type, int16_t fd){
+CrudCompletion c;
+
+	for(c = 0; c < CRUD_MAX_ASYNC_OPS && crud_async_ops[c].type != CRUD_ASYNC_FREE; c++);
+	if(c == CRUD_MAX_ASYNC_OPS)
+		return -1;
+	memset(&crud_async_ops[c], 0, sizeof(CrudAsyncOp));
+	crud_async_ops[c].type = type;
+	crud_async_ops[c].fd = fd;
+	return c;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finishes an asynchronous operation: collects the responses to its
+//           updates and, for a read, copies the data into the callers buffer
+//IN: the operation
+//Out: none (the result of the operation is set)
+void finishAsyncOp(CrudAsyncOp *op){
+CrudOID ID;
+int32_t length=0;
+int result;
+uint32_t i;
+
+	if(op->done)
+		return;
+	for(i = 0; i < op->posted; i++){
+		decryptResponse(crud_client_complete(op->tickets[i]), &ID, &length, &result);
+		if(result != 0)
+			op->result = -1;
+	}
+	op->posted = 0;
+	if(op->type == CRUD_ASYNC_READ && op->result != -1 && finishRead(op->fd, op->pos, op->count, op->buf) != 0)
+		op->result = -1;
+	op->done = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finishes the asynchronous reads of a file that are in flight
+//IN: file descriptor
+//Out: none
+void finishAsyncReads(int16_t fd){
+
+	for(int i = 0; i < CRUD_MAX_ASYNC_OPS; i++)
+		if(crud_async_ops[i].type == CRUD_ASYNC_READ && crud_async_ops[i].fd == fd)
+			finishAsyncOp(&crud_async_ops[i]);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads bytes from one chunk of a file into the callers buffer, safe
+//           to call from several threads sharing the file system lock (the
+//           cached copy is only touched under the cache lock)
+//IN: the chunk OID and its length, flag for the chunk possibly being stored
+//    compressed, the offset and count to read, the buffer
+//Out: 0 if successful, -1 if failure
+int copyChunk(CrudOID oid, uint32_t objLength, int compressed, uint32_t offset, uint32_t count, char *buf){
+char *temp;
+
+	//holes read back as zeros
+	if(oid == CRUD_NO_OBJECT){
+		memset(buf, 0, count);
+		return 0;
+	}
+
+	//serve from the cache, the range or the whole object as readChunk does
+	if(copy_crud_cache(oid, offset, count, buf) == 0)
+		return 0;
+	if(crud_network_extensions && !compressed && (offset != 0 || count != objLength))
+		return (readRange(oid, offset, count, buf) == (int32_t)count) ? 0 : -1;
+	if(offset == 0 && count == objLength)
+		return readObject(oid, objLength, buf);
+
+	//read the whole object, the cache takes the buffer over
+	if((temp = alloc_crud_pool(objLength)) == NULL)
+		return -1;
+	if(readObject(oid, objLength, temp) != 0){
+		free_crud_pool(temp);
+		return -1;
+	}
+	memcpy(buf, &temp[offset], count);
+	init_crud_cache();
+	adopt_crud_cache(oid, temp, objLength);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : reads bytes of a file at a position, without touching the file
+//           position or the read ahead.  With the lock shared nothing of the
+//           file is changed: a read that would need buffered writes written
+//           out or the extent map read in asks for the lock exclusively.
+//IN: file descriptor, position, count, buffer, flag for the lock being
+//    shared, place to put the number of bytes read
+//Out: 0 if successful, 1 if it needs the lock exclusively, -1 if failure
+int readAt(int16_t fd, uint32_t pos, int32_t count, char *buf, int shared, int32_t *amtRead){
+CrudWriteBuffer *wb = &crud_write_buffers[fd];
+uint32_t fileLength, idx, off, objLength, base;
+int32_t done = 0, n;
+CrudOID chunk;
+
+	//buffered writes that grow the file or fall in the range have to go out first
+	for(uint32_t i = 0; i < wb->count; i++){
+		if(wb->end > fileEntry(fd)->length || (count > 0 && wb->chunks[i].idx >= pos / CRUD_CHUNK_SIZE &&
+		   wb->chunks[i].idx <= (pos + count - 1) / CRUD_CHUNK_SIZE)){
+			if(shared)
+				return 1;
+			if(flushWriteBuffer(fd) != 0)
+				return -1;
+			break;
+		}
+	}
+	fileLength = fileEntry(fd)->length;
+	if(fileLength == 0)
+		return -1;
+
+	// determine the amount read to the passed buffer
+	if(pos >= fileLength || count <= 0)
+		*amtRead = 0;
+	else if((uint32_t)count > fileLength - pos)
+		*amtRead = fileLength - pos;
+	else
+		*amtRead = count;
+
+	//a tiny file is right there in the table
+	if(inlineFile(fileEntry(fd))){
+		memcpy(buf, &fileEntry(fd)->contents[pos], *amtRead);
+		return 0;
+	}
+
+	//the chunks past the direct ones are found through the extent map
+	if(*amtRead > 0 && (pos + *amtRead - 1) / CRUD_CHUNK_SIZE >= CRUD_DIRECT_CHUNKS && !crud_extent_maps[fd].loaded){
+		if(shared)
+			return 1;
+		if(loadExtentMap(fd) != 0)
+			return -1;
+	}
+
+	//read from each chunk the range covers
+	while(done < *amtRead){
+		idx = (pos + done) / CRUD_CHUNK_SIZE;
+		off = (pos + done) % CRUD_CHUNK_SIZE;
+		n = (CRUD_CHUNK_SIZE - off < (uint32_t)(*amtRead - done)) ? CRUD_CHUNK_SIZE - off : *amtRead - done;
+
+		if(chunkObject(fd, idx, fileLength, &chunk, &objLength, &base) != 0 ||
+		   copyChunk(chunk, objLength, compressedFile(fd), base + off, n, buf + done) != 0)
+			return -1;
+		done += n;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes bytes at a position of an open file (through the write buffer)
+//IN: file descriptor, position, the bytes and how many
+//Out: 0 if successful, -1 if failure
+int writeAt(int16_t fd, uint32_t pos, char *buf, uint32_t count){
+CrudWriteBuffer *wb = &crud_write_buffers[fd];
+
+	//writing past the end of the file, write out the buffer first so the
+	//file length is settled before the gap (as a seek there would)
+	if(wb->count > 0 && pos > fileEntry(fd)->length && pos > wb->end && flushWriteBuffer(fd) != 0)
+		return -1;
+	return bufferWrite(fd, pos, buf, count);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes the bytes changed in a mapped view back to its file, a run
+//           of changed blocks goes out as one write trimmed to the changed bytes
+//IN: the view
+//Out: 0 if successful, -1 if failure
+int writeBackView(CrudMappedView *view){
+uint32_t start, end, n;
+
+	if(!(view->flags & CRUD_MAP_WRITE))
+		return 0;
+
+	for(start = 0; start < view->length; start = end){
+		n = (view->length - start < CRUD_MAP_BLOCK) ? view->length - start : CRUD_MAP_BLOCK;
+		end = start + n;
+		if(memcmp(&view->data[start], &view->clean[start], n) == 0)
+			continue;
+
+		//take in the changed blocks that follow
+		while(end < view->length){
+			n = (view->length - end < CRUD_MAP_BLOCK) ? view->length - end : CRUD_MAP_BLOCK;
+			if(memcmp(&view->data[end], &view->clean[end], n) == 0)
+				break;
+			end += n;
+		}
+
+		//trim the unchanged bytes at the ends (so the file only grows as far as the changes)
+		while(view->data[start] == view->clean[start])
+			start++;
+		while(view->data[end-1] == view->clean[end-1])
+			end--;
+		if(writeAt(view->fd, view->offset + start, &view->data[start], end - start) != 0)
+			return -1;
+		memcpy(&view->clean[start], &view->data[start], end - start);
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : writes back and releases the mapped views of a file (closing it)
+//IN: file descriptor, -1 to release every view without writing it back
+//Out: 0 if successful, -1 if failure
+int releaseViews(int16_t fd){
+CrudMappedView *view;
+
+	for(view = crud_views; view < &crud_views[CRUD_MAX_MAPPED_VIEWS]; view++){
+		if(view->data == NULL || (fd != -1 && view->fd != fd))
+			continue;
+		if(fd != -1 && writeBackView(view) != 0)
+			return -1;
+		free_crud_pool(view->data);
+		free_crud_pool(view->clean);
+		memset(view, 0, sizeof(CrudMappedView));
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : finds the mapped view a pointer from crud_map refers to
+//IN: the pointer
+//Out: the view, NULL if it is not a view
+CrudMappedView *findView(void *data){
+CrudMappedView *view;
+
+	for(view = crud_views; view < &crud_views[CRUD_MAX_MAPPED_VIEWS]; view++){
+		if(data != NULL && view->data == data)
+			return view;
+	}
+	return NULL;
+}
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_open
+// Description  : This function opens the file and returns a file handle
+//
+// Inputs       : path - the path "in the storage array"
+// Outputs      : file handle if successful, -1 if failure
+
+int16_t crud_open(char *path) {
+int16_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = openFile(path);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_open, called with the file system locked
+//IN: see crud_open
+//Out: see crud_open
+int16_t openFile(char *path){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+//
+//Local variables
+//
+
+//check to see if the Crud system is initialized
+// if not then it initialies the system
+	if(init == 0){
+		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
+		response = crud_client_operation(request,NULL); 
+		decryptResponse(response,&ID,&length, &result);	
+		if(result!=0)
+			return -1;
+		init = 1;
+    	}
+
+
+	//the table may not have come from mount/format (e.g., open before mount)
+	if(crud_path_buckets == NULL && resetFileTable() != 0)
+		return -1;
+
+// finds the path in the table
+	uint32_t slot;
+	if (findPath(path, &slot) != 0)
+		return -1;
+
+//if the file is already open, hand back the same handle
+	if (slot != CRUD_NO_SLOT && crud_table_pages[slot / CRUD_FILES_PER_PAGE].handles[slot % CRUD_FILES_PER_PAGE] != -1){
+		int x = crud_table_pages[slot / CRUD_FILES_PER_PAGE].handles[slot % CRUD_FILES_PER_PAGE];
+		crud_open_files[x].position = 0;
+		return x;
+	}
+	if (crud_free_count == 0)
+		return -1;
+
+//stores information about object in the found index
+	if (slot == CRUD_NO_SLOT){
+        	// Assign file new slot in the file table
+        	if (allocateSlot(&slot) != 0)
+            		return -1;
+
+        	// Copy path into filename, set initial contents to empty
+        	CrudFileAllocationType *entry = slotEntry(slot);
+        	memset(entry, 0, sizeof(CrudFileAllocationType));
+        	strcpy(entry->filename, path);
+        	if (crud_file_compression)
+        		entry->flags = CRUD_FILE_COMPRESSED;
+        	if (indexPath(slot) != 0 || addNameFilter(path) != 0 || addPathRecord(slot) != 0)
+            		return -1;
+    	}
+
+	//take a free handle for the file
+	int x = crud_free_handles[--crud_free_count];
+	crud_open_files[x].slot = slot;
+	crud_open_files[x].position = 0;
+	crud_open_files[x].open = 1;
+	crud_table_pages[slot / CRUD_FILES_PER_PAGE].handles[slot % CRUD_FILES_PER_PAGE] = x;
+
+	return x;//returns handle index
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_close
+// Description  : This function closes the file
+//
+// Inputs       : fd - the file handle of the object to close
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_close(int16_t fh) {
+int16_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = closeFile(fh);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_close, called with the file system locked
+//IN: see crud_close
+//Out: see crud_close
+int16_t closeFile(int16_t fh){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+	
+	//check to see if the Crud system is initialized
+	// if not then it initialies the system
+	if(init == 0){
+		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
+		response = crud_client_operation(request,NULL); 
+		decryptResponse(response,&ID,&length, &result);	
+		if(result!=0)
+			return -1;
+		init = 1;
+    	}
+
+	//check if the file is open
+	if(openCheck(fh))
+		return -1;
+
+	//write out the mapped views, the buffered bytes and the extent map of the file
+	finishAsyncReads(fh);
+	dropReadAhead(fh);
+	if(releaseViews(fh) != 0 || flushWriteBuffer(fh) != 0 || releaseExtentMap(fh) != 0)
+		return -1;
+
+	// change the open marker to 0, free the handle and return 0
+	uint32_t slot = crud_open_files[fh].slot;
+	crud_table_pages[slot / CRUD_FILES_PER_PAGE].handles[slot % CRUD_FILES_PER_PAGE] = -1;
+	crud_open_files[fh].open = 0;
+	crud_free_handles[crud_free_count++] = fh;
+	return 0;
+
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_read
+// Description  : Reads up to "count" bytes from the file handle "fh" into the
+//                buffer  "buf".
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+// Outputs      : the number of bytes read or -1 if failures
+
+int32_t crud_read(int16_t fd, void *buf, int32_t count) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = readFile(fd, buf, count);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_read, called with the file system locked
+//IN: see crud_read
+//Out: see crud_read
+int32_t readFile(int16_t fd, void *buf, int32_t count){
+CrudOID ID;
+int32_t length=0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+uint32_t pos;
+int32_t amtRead = 0;
+//
+//local variables
+//
+
+	//check to see if the Crud system is initialized
+	// if not then it initialies the system
+	if(init == 0){
+		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
+		response = crud_client_operation(request,NULL); 
+		decryptResponse(response,&ID,&length, &result);	
+		if(result!=0)
+			return -1;
+		init = 1;
+    	}
+
+	//check to see is the file is open 
+	if(openCheck(fd))
+		return -1;	
+	pos = crud_open_files[fd].position;
+
+	//post the chunk reads, then copy the chunks out as they come in
+	if(startRead(fd, pos, count, &amtRead, 0) != 0 || finishRead(fd, pos, amtRead, buf) != 0)
+		return -1;
+
+	//adjust the position of the file
+	crud_open_files[fd].position += amtRead;
+	return amtRead;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_write
+// Description  : Writes "count" bytes to the file handle "fh" from the
+//                buffer  "buf"
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write
+//                count - the number of bytes to write
+// Outputs      : the number of bytes written or -1 if failure
+
+int32_t crud_write(int16_t fd, void *buf, int32_t count) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = writeFile(fd, buf, count);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_write, called with the file system locked
+//IN: see crud_write
+//Out: see crud_write
+int32_t writeFile(int16_t fd, void *buf, int32_t count){
+
+CrudOID ID;
+int32_t length =0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+uint32_t pos;
+
+//
+//local variables
+//
+
+	//check to see if the Crud system is initialized
+	// if not then it initialies the system
+	if(init == 0){
+		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
+		response = crud_client_operation(request,NULL); 
+		decryptResponse(response,&ID,&length, &result);	
+		if(result!=0)
+			return -1;
+		init = 1;
+    	}
+
+	//check to see if file is open
+	if(openCheck(fd))
+		return -1;
+	pos = crud_open_files[fd].position;
+
+	if(count <= 0)
+		return 0;
+
+	//collect the bytes in the write buffer, they go out on a flush
+	if(bufferWrite(fd, pos, buf, count) != 0)
+		return -1;
+
+	crud_open_files[fd].position += count;
+	return count;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : adds up the lengths of the buffers of a vectored read or write
+//IN: the buffers and the number of them
+//Out: the total, -1 if the count is bad or the total does not fit a count
+int32_t iovecLength(const struct iovec *iov, int iovcnt){
+int32_t total = 0;
+int k;
+
+	if(iovcnt < 0)
+		return -1;
+	for(k = 0; k < iovcnt; k++){
+		if(iov[k].iov_len > (size_t)(INT32_MAX - total))
+			return -1;
+		total += iov[k].iov_len;
+	}
+	return total;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_readv
+// Description  : Reads from the file handle into each of the buffers of "iov"
+//                in turn, as a single read (the chunks are fetched once and
+//                copied straight into the buffers)
+//
+// Inputs       : fd - the file descriptor for the read
+//                iov - the buffers to place the bytes into
+//                iovcnt - the number of buffers
+// Outputs      : the number of bytes read or -1 if failures (or the lengths
+//                add up to more than INT32_MAX)
+
+int32_t crud_readv(int16_t fd, const struct iovec *iov, int iovcnt) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = readvFile(fd, iov, iovcnt);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_readv, called with the file system locked
+//IN: see crud_readv
+//Out: see crud_readv
+int32_t readvFile(int16_t fd, const struct iovec *iov, int iovcnt){
+uint32_t pos;
+int32_t count, amtRead = 0, done = 0, n;
+int k;
+
+	//check to see is the file is open 
+	if(init == 0 || openCheck(fd) || (count = iovecLength(iov, iovcnt)) == -1)
+		return -1;
+	pos = crud_open_files[fd].position;
+
+	//post the chunk reads for the whole range (once, even within one chunk
+	//when there are several buffers), then fill each buffer in turn
+	if(startRead(fd, pos, count, &amtRead, iovcnt > 1) != 0)
+		return -1;
+	for(k = 0; k < iovcnt && done < amtRead; k++){
+		n = ((int32_t)iov[k].iov_len < amtRead - done) ? (int32_t)iov[k].iov_len : amtRead - done;
+		if(finishRead(fd, pos + done, n, iov[k].iov_base) != 0)
+			return -1;
+		done += n;
+	}
+
+	//adjust the position of the file
+	crud_open_files[fd].position += amtRead;
+	return amtRead;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_writev
+// Description  : Writes each of the buffers of "iov" in turn to the file
+//                handle, as a single write (copied straight into the write
+//                buffer of the file)
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                iov - the buffers to write from
+//                iovcnt - the number of buffers
+// Outputs      : the number of bytes written (those of the buffers before a
+//                failure), -1 if failure before any or the lengths add up
+//                to more than INT32_MAX
+
+int32_t crud_writev(int16_t fd, const struct iovec *iov, int iovcnt) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = writevFile(fd, iov, iovcnt);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_writev, called with the file system locked
+//IN: see crud_writev
+//Out: see crud_writev
+int32_t writevFile(int16_t fd, const struct iovec *iov, int iovcnt){
+uint32_t pos;
+int32_t done = 0;
+int k;
+
+	//check to see if file is open
+	if(init == 0 || openCheck(fd) || iovecLength(iov, iovcnt) == -1)
+		return -1;
+	pos = crud_open_files[fd].position;
+
+	//a failure after some buffers went in reports those, as writev(2) does
+	for(k = 0; k < iovcnt; k++){
+		if(iov[k].iov_len > 0 && bufferWrite(fd, pos + done, iov[k].iov_base, iov[k].iov_len) != 0){
+			if(done == 0)
+				return -1;
+			break;
+		}
+		done += iov[k].iov_len;
+	}
+
+	crud_open_files[fd].position += done;
+	return done;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pread
+// Description  : Reads up to "count" bytes at position "loc" of the file
+//                handle into the buffer "buf", leaving the file position
+//                alone.  Several threads can read at once, even the same file.
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+//                loc - offset from beginning of file to read from
+// Outputs      : the number of bytes read or -1 if failures
+
+int32_t crud_pread(int16_t fd, void *buf, int32_t count, uint32_t loc) {
+int32_t amtRead = 0;
+int ret = -1;
+
+	//readers share the lock as long as they don't have to change the file
+	pthread_rwlock_rdlock(&crud_io_lock);
+	if(init != 0 && !openCheck(fd))
+		ret = readAt(fd, loc, count, buf, 1, &amtRead);
+	pthread_rwlock_unlock(&crud_io_lock);
+
+	if(ret == 1){
+		pthread_rwlock_wrlock(&crud_io_lock);
+		ret = (init != 0 && !openCheck(fd)) ? readAt(fd, loc, count, buf, 0, &amtRead) : -1;
+		pthread_rwlock_unlock(&crud_io_lock);
 	}
-	
-	if(crud_file_table[fd].position + count > crud_file_table[fd].length){
-	
-	        // Allocate new buffer of appropriate size
-                char *newBuf = malloc(crud_file_table[fd].position + count);
-                
-		// Copy old memory into newBuf
-	        memcpy(newBuf, temp, crud_file_table[fd].length);
-                
-		// Copy new bytes into newBuf at position 
-                memcpy(&newBuf[crud_file_table[fd].position], buf, count);
-
-		request = construct_crud_request(0, CRUD_CREATE,  crud_file_table[fd].position + count, 0,0);
-		response = crud_client_operation(request,newBuf); 
+	return (ret == 0) ? amtRead : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pwrite
+// Description  : Writes "count" bytes at position "loc" of the file handle
+//                from the buffer "buf", leaving the file position alone
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write
+//                count - the number of bytes to write
+//                loc - offset from beginning of file to write at
+// Outputs      : the number of bytes written or -1 if failure
+
+int32_t crud_pwrite(int16_t fd, void *buf, int32_t count, uint32_t loc) {
+int32_t ret = count;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	if(init == 0 || openCheck(fd))
+		ret = -1;
+	else if(count > 0 && writeAt(fd, loc, buf, count) != 0)
+		ret = -1;
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_seek
+// Description  : Seek to specific point in the file
+//
+// Inputs       : fd - the file descriptor for the file to seek
+//                loc - offset from beginning of file to seek to
+// Outputs      : 0 if successful or -1 if failure
+
+int32_t crud_seek(int16_t fd, uint32_t loc) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = seekFile(fd, loc);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_seek, called with the file system locked
+//IN: see crud_seek
+//Out: see crud_seek
+int32_t seekFile(int16_t fd, uint32_t loc){
+
+CrudOID ID;
+int32_t length =0;
+int result;
+CrudRequest request;
+CrudResponse response;
+
+//
+//local variables
+//
+
+
+	//check to see if the Crud system is initialized
+	// if not then it initialies the system
+	if(init == 0){
+		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
+		response = crud_client_operation(request,NULL); 
 		decryptResponse(response,&ID,&length, &result);	
+		if(result!=0)
+			return -1;
+		init = 1;
+    	}
+
+	//check to see if file is open
+	if(openCheck(fd))
+		return -1;
+
+
+	//seeking past the end of the file, write out the buffer so the file
+	//length is settled before the gap
+	CrudWriteBuffer *wb = &crud_write_buffers[fd];
+	if(wb->count > 0 && loc > fileEntry(fd)->length && loc > wb->end){
+		if(flushWriteBuffer(fd) != 0)
+			return -1;
+	}
+
+	//update the file position
+	crud_open_files[fd].position = loc;
 	
-		free(temp);
-		free(newBuf);
+	return 0;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_flush
+// Description  : Write out the writes to the file that are still buffered
+//
+// Inputs       : fd - the file descriptor for the file to flush
+// Outputs      : 0 if successful or -1 if failure
+
+int32_t crud_flush(int16_t fd) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = flushFile(fd);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_flush, called with the file system locked
+//IN: see crud_flush
+//Out: see crud_flush
+int32_t flushFile(int16_t fd){
+
+	//check to see if file is open
+	if(init == 0 || openCheck(fd))
+		return -1;
+
+	return flushWriteBuffer(fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_compress
+// Description  : Switches on compression for a file: the chunk objects it
+//                writes from now on are stored compressed (existing objects
+//                are read as they are, packed and tiny files are unaffected)
+//
+// Inputs       : fd - the file descriptor for the file to compress
+// Outputs      : 0 if successful or -1 if failure
+
+int32_t crud_compress(int16_t fd) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = compressFile(fd);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_compress, called with the file system locked
+//IN: see crud_compress
+//Out: see crud_compress
+int32_t compressFile(int16_t fd){
+
+	//check to see if file is open
+	if(init == 0 || openCheck(fd))
+		return -1;
+
+	if(!compressedFile(fd)){
+		fileEntry(fd)->flags |= CRUD_FILE_COMPRESSED;
+		markFileDirty(fd);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_truncate
+// Description  : Sets the length of a file.  A shorter file lets go of the
+//                chunk objects past its new end and has its last one cut down
+//                on the server (no file data is sent when the server supports
+//                the extensions), a longer one reads back zeros past the old
+//                end.  The file position is left alone.
+//
+// Inputs       : fd - the file descriptor for the file to truncate
+//                length - the new length of the file
+// Outputs      : 0 if successful or -1 if failure
+
+int32_t crud_truncate(int16_t fd, uint32_t length) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = truncateFile(fd, length);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_truncate, called with the file system locked
+//IN: see crud_truncate
+//Out: see crud_truncate
+int32_t truncateFile(int16_t fd, uint32_t length){
+CrudExtentMap *map = &crud_extent_maps[fd];
+uint32_t fileLength, idx, chunks, keep;
+CrudOID chunk, ID;
+char *zeros;
+int result;
+
+	//check to see if file is open
+	if(init == 0 || openCheck(fd))
+		return -1;
+
+	//the buffered writes go out first, reads in flight finish before the
+	//bytes they read go away
+	if(flushWriteBuffer(fd) != 0)
+		return -1;
+	finishAsyncReads(fd);
+	dropReadAhead(fd);
+	fileLength = fileEntry(fd)->length;
+
+	//growing, an empty write at the new end fills out the last chunk
+	if(length >= fileLength)
+		return (length == fileLength) ? 0 : writeThrough(fd, length, NULL, 0);
+
+	//a tiny file just clears the bytes past its new end
+	if(inlineFile(fileEntry(fd)))
+		memset(&fileEntry(fd)->contents[length], 0, fileLength - length);
+
+	//a packed file zeros them in its slab, an empty one leaves the slab
+	else if(fileEntry(fd)->slab != CRUD_NO_OBJECT && length == 0){
+		fileEntry(fd)->slab = CRUD_NO_OBJECT;
+		fileEntry(fd)->slab_offset = 0;
+	}
+	else if(fileEntry(fd)->slab != CRUD_NO_OBJECT){
+		if((zeros = alloc_crud_pool(fileLength - length)) == NULL)
+			return -1;
+		memset(zeros, 0, fileLength - length);
+		chunk = fileEntry(fd)->slab;
+		result = writeChunk(&chunk, CRUD_SLAB_SIZE, CRUD_SLAB_SIZE, fileEntry(fd)->slab_offset + length, fileLength - length, zeros);
+		free_crud_pool(zeros);
+		if(result != 0)
+			return -1;
+	}
+
+	//otherwise the chunks past the new end are let go of and the new last
+	//chunk is cut down to size
+	else{
+		chunks = (length + CRUD_CHUNK_SIZE - 1) / CRUD_CHUNK_SIZE;
+		for(idx = chunks; idx < (fileLength + CRUD_CHUNK_SIZE - 1) / CRUD_CHUNK_SIZE; idx++){
+			if(getChunk(fd, idx, &chunk) != 0 || releaseChunk(chunk) != 0)
+				return -1;
+			if(idx < CRUD_DIRECT_CHUNKS && setChunk(fd, idx, CRUD_NO_OBJECT) != 0)
+				return -1;
+		}
+		if(map->loaded && map->count + CRUD_DIRECT_CHUNKS > chunks){
+			map->count = (chunks > CRUD_DIRECT_CHUNKS) ? chunks - CRUD_DIRECT_CHUNKS : 0;
+			map->dirty = 1;
+		}
+
+		keep = (chunks > 0) ? chunkLength(chunks - 1, length) : 0;
+		if(chunks > 0 && keep < chunkLength(chunks - 1, fileLength)){
+			if(getChunk(fd, chunks - 1, &chunk) != 0)
+				return -1;
+			ID = chunk;
+			if(chunk != CRUD_NO_OBJECT && shrinkChunk(fd, &chunk, chunkCapacity(chunks - 1, fileLength),
+					chunkCapacity(chunks - 1, length), keep) != 0)
+				return -1;
+			if(chunk != ID && setChunk(fd, chunks - 1, chunk) != 0)
+				return -1;
+		}
+	}
+
+	fileEntry(fd)->length = length;
+	markFileDirty(fd);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_clone
+// Description  : Makes the file "dst" (created, or emptied if it exists) a
+//                copy of the file "src".  The chunk objects are shared copy on
+//                write, or copied on the server, so no file data is sent when
+//                the server supports the extensions (small packed files are
+//                the exception, they are copied into a slab slot of their own).
+//
+// Inputs       : src - the path of the file to copy
+//                dst - the path of the copy
+// Outputs      : 0 if successful or -1 if failure
+
+int32_t crud_clone(char *src, char *dst) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = cloneFile(src, dst);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : makes an emptied open file a copy of another open file
+//IN: file descriptors of the file copied and the copy
+//Out: 0 if successful, -1 if failure
+int cloneEntry(int16_t sfd, int16_t dfd){
+uint32_t fileLength = fileEntry(sfd)->length;
+uint32_t idx;
+CrudOID chunk, copy;
+char *data;
+int result;
+
+	fileEntry(dfd)->flags = fileEntry(sfd)->flags;
+	markFileDirty(dfd);
+
+	//a tiny file is copied along with the entry
+	if(inlineFile(fileEntry(sfd))){
+		memcpy(fileEntry(dfd)->contents, fileEntry(sfd)->contents, CRUD_MAX_INLINE_LENGTH);
+		fileEntry(dfd)->length = fileLength;
+		return 0;
+	}
+
+	//a packed file is written out again (its slab slot is changed in place)
+	if(fileEntry(sfd)->slab != CRUD_NO_OBJECT){
+		if((data = alloc_crud_pool(fileLength)) == NULL)
+			return -1;
+		result = readChunk(fileEntry(sfd)->slab, CRUD_SLAB_SIZE, 0, fileEntry(sfd)->slab_offset, fileLength, data);
+		if(result == 0)
+			result = writeThrough(dfd, 0, data, fileLength);
+		free_crud_pool(data);
+		return result;
+	}
+
+	//any other file gets a reference to each chunk object (holes stay holes)
+	for(idx = 0; idx < (fileLength + CRUD_CHUNK_SIZE - 1) / CRUD_CHUNK_SIZE; idx++){
+		if(getChunk(sfd, idx, &chunk) != 0)
+			return -1;
+		if(chunk != CRUD_NO_OBJECT && (cloneChunk(sfd, chunk, chunkCapacity(idx, fileLength), &copy) != 0 ||
+				setChunk(dfd, idx, copy) != 0))
+			return -1;
+	}
+	fileEntry(dfd)->length = fileLength;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_clone, called with the file system locked
+//IN: see crud_clone
+//Out: see crud_clone
+int32_t cloneFile(char *src, char *dst){
+uint32_t slot;
+int16_t sfd, dfd;
+int srcOpened = 0, dstOpened = 0, result;
+
+	//the source has to be there already (a clone of itself is itself)
+	if(init == 0 || crud_path_buckets == NULL || findPath(src, &slot) != 0 || slot == CRUD_NO_SLOT)
+		return -1;
+	if(strcmp(src, dst) == 0)
+		return 0;
+
+	//use the handles of open files, open the others for the copy
+	if((sfd = crud_table_pages[slot / CRUD_FILES_PER_PAGE].handles[slot % CRUD_FILES_PER_PAGE]) == -1){
+		if((sfd = openFile(src)) == -1)
+			return -1;
+		srcOpened = 1;
+	}
+	if(findPath(dst, &slot) != 0){
+		if(srcOpened)
+			closeFile(sfd);
+		return -1;
+	}
+	if(slot == CRUD_NO_SLOT || (dfd = crud_table_pages[slot / CRUD_FILES_PER_PAGE].handles[slot % CRUD_FILES_PER_PAGE]) == -1){
+		if((dfd = openFile(dst)) == -1){
+			if(srcOpened)
+				closeFile(sfd);
+			return -1;
+		}
+		dstOpened = 1;
+	}
+
+	//the buffered writes of the source go out, the copy starts out empty
+	result = (flushWriteBuffer(sfd) != 0 || truncateFile(dfd, 0) != 0 || cloneEntry(sfd, dfd) != 0) ? -1 : 0;
+
+	if(dstOpened && closeFile(dfd) != 0)
+		result = -1;
+	if(srcOpened && closeFile(sfd) != 0)
+		result = -1;
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_stat
+// Description  : Gets the length and flags of a file without opening it.  The
+//                path is looked up in the path index, a path that is not in
+//                the table is not given a slot.
+//
+// Inputs       : path - the path of the file
+//                stat - where to put what is known about the file
+// Outputs      : 0 if successful or -1 if failure (no such file)
+
+int32_t crud_stat(char *path, CrudFileStat *stat) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = statFile(path, stat);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_stat, called with the file system locked
+//IN: see crud_stat
+//Out: see crud_stat
+int32_t statFile(char *path, CrudFileStat *stat){
+uint32_t slot;
+
+	if(init == 0 || crud_path_buckets == NULL || findPath(path, &slot) != 0 || slot == CRUD_NO_SLOT)
+		return -1;
+	statSlot(slot, stat);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_list
+// Description  : Calls "cb" for each file whose path starts with "prefix" (""
+//                for every file) in path order.  The files are found in the
+//                name index CRUD_LIST_BATCH at a time and the callback is
+//                called with the file system unlocked, so it may use the file
+//                system (files it creates past the last one listed are listed).
+//
+// Inputs       : prefix - the start of the paths to list
+//                cb - the function called for each file (non-zero stops the listing)
+//                arg - passed on to the callback
+// Outputs      : the number of files passed to the callback or -1 if failure
+
+int32_t crud_list(char *prefix, CrudListCallback cb, void *arg) {
+CrudFileStat *stats;
+char last[CRUD_MAX_PATH_LENGTH];
+int32_t listed = 0, found, i;
+
+	if((stats = malloc(CRUD_LIST_BATCH * sizeof(CrudFileStat))) == NULL)
+		return -1;
+	do{
+		pthread_rwlock_wrlock(&crud_io_lock);
+		found = listFiles(prefix, (listed > 0) ? last : NULL, stats, CRUD_LIST_BATCH);
+		pthread_rwlock_unlock(&crud_io_lock);
+
+		for(i = 0; i < found; i++){
+			listed++;
+			if(cb(&stats[i], arg) != 0){
+				free(stats);
+				return listed;
+			}
+		}
+		if(found > 0)
+			strcpy(last, stats[found-1].path);
+	}while(found == CRUD_LIST_BATCH);
+
+	free(stats);
+	return (found < 0) ? -1 : listed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_list, called with the file system locked: looks up the next
+//           files of a listing
+//IN: the prefix, the last path listed (NULL for the first files), place to
+//    put the files, most files to put there
+//Out: number of files found, -1 if failure
+int32_t listFiles(char *prefix, char *after, CrudFileStat *stats, uint32_t max){
+size_t length = strlen(prefix);
+uint32_t pos;
+int32_t count = 0;
+
+	if(init == 0 || crud_path_buckets == NULL || sortNames() != 0)
+		return -1;
+	for(pos = findName(prefix, after); pos < crud_name_count && count < (int32_t)max; pos++){
+		if(strncmp(slotEntry(crud_name_slots[pos])->filename, prefix, length) != 0)
+			break;
+		statSlot(crud_name_slots[pos], &stats[count++]);
+	}
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_read_async
+// Description  : Starts reading up to "count" bytes from the file handle into
+//                the buffer "buf", the chunk reads are posted right away
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into (valid until waited for)
+//                count - the number of bytes to read
+// Outputs      : the completion handle or -1 if failure
+
+CrudCompletion crud_read_async(int16_t fd, void *buf, int32_t count) {
+CrudCompletion ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = readFileAsync(fd, buf, count);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_read_async, called with the file system locked
+//IN: see crud_read_async
+//Out: see crud_read_async
+CrudCompletion readFileAsync(int16_t fd, void *buf, int32_t count){
+CrudCompletion c;
+CrudAsyncOp *op;
+
+	//check to see if file is open
+	if(init == 0 || openCheck(fd) || (c = startAsyncOp(CRUD_ASYNC_READ, fd)) == -1)
+		return -1;
+	op = &crud_async_ops[c];
+	op->buf = buf;
+	op->pos = crud_open_files[fd].position;
+
+	//the flush of buffered writes the read would see is posted for it too
+	crud_async_deferring = op;
+	if(startRead(fd, op->pos, count, &op->count, 1) != 0){
+		op->result = -1;
+		op->count = 0;
+	}
+	else{
+		op->result = op->count;
+		crud_open_files[fd].position += op->count;
+	}
+	crud_async_deferring = NULL;
+	return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_write_async
+// Description  : Starts writing "count" bytes to the file handle from the
+//                buffer "buf", updates going out for it are not waited for
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write from (copied before returning)
+//                count - the number of bytes to write
+// Outputs      : the completion handle or -1 if failure
+
+CrudCompletion crud_write_async(int16_t fd, void *buf, int32_t count) {
+CrudCompletion ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = writeFileAsync(fd, buf, count);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_write_async, called with the file system locked
+//IN: see crud_write_async
+//Out: see crud_write_async
+CrudCompletion writeFileAsync(int16_t fd, void *buf, int32_t count){
+CrudCompletion c;
+CrudAsyncOp *op;
+
+	//check to see if file is open
+	if(init == 0 || openCheck(fd) || (c = startAsyncOp(CRUD_ASYNC_WRITE, fd)) == -1)
+		return -1;
+	op = &crud_async_ops[c];
+	if(count <= 0)
+		return c;
+
+	crud_async_deferring = op;
+	if(bufferWrite(fd, crud_open_files[fd].position, buf, count) != 0)
+		op->result = -1;
+	else{
+		op->result = count;
+		crud_open_files[fd].position += count;
+	}
+	crud_async_deferring = NULL;
+	return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_flush_async
+// Description  : Starts writing out the writes to the file that are still
+//                buffered, the updates are posted without waiting
+//
+// Inputs       : fd - the file descriptor for the file to flush
+// Outputs      : the completion handle or -1 if failure
+
+CrudCompletion crud_flush_async(int16_t fd) {
+CrudCompletion ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = flushFileAsync(fd);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_flush_async, called with the file system locked
+//IN: see crud_flush_async
+//Out: see crud_flush_async
+CrudCompletion flushFileAsync(int16_t fd){
+CrudCompletion c;
+
+	//check to see if file is open
+	if(init == 0 || openCheck(fd) || (c = startAsyncOp(CRUD_ASYNC_FLUSH, fd)) == -1)
+		return -1;
+
+	crud_async_deferring = &crud_async_ops[c];
+	crud_async_ops[c].result = flushWriteBuffer(fd);
+	crud_async_deferring = NULL;
+	return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_poll
+// Description  : Checks if an asynchronous operation has finished, without
+//                waiting for anything still in flight
+//
+// Inputs       : op - the completion handle
+// Outputs      : 1 if finished, 0 if in flight, -1 if failure
 
-		if(result!=0)
-			return -1;
-		
-		CrudOID tempID =ID;
-	
-		
-		request = construct_crud_request(crud_file_table[fd].object_id, CRUD_DELETE,  0, 0,0);
-		response = crud_client_operation(request,NULL); 
-		decryptResponse(response,&ID,&length, &result);	
- 
-		if(result!=0)
-			return -1;
-		
-		// Update file information
-            	crud_file_table[fd].object_id = tempID;
-            	crud_file_table[fd].length = crud_file_table[fd].position + count;
-            	crud_file_table[fd].position += count;
-		
-		
-		return count;
-	}
+int crud_poll(CrudCompletion op) {
+int ret;
 
-	else{
-		memcpy(&temp[crud_file_table[fd].position], buf, count);
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = pollAsyncOp(op);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
 
-		request = construct_crud_request(crud_file_table[fd].object_id, CRUD_UPDATE,  crud_file_table[fd].length, 0,0);
-		response = crud_client_operation(request,temp); 
-		decryptResponse(response,&ID,&length, &result);	
-		
-		free(temp);
- 
-		if(result!=0)
-			return -1;
-		
-		crud_file_table[fd].position += count;
-		return count;
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_poll, called with the file system locked
+//IN: see crud_poll
+//Out: see crud_poll
+int pollAsyncOp(CrudCompletion op){
+CrudAsyncOp *ao;
+CrudReadAhead *ra;
+uint32_t i;
+
+	if(op < 0 || op >= CRUD_MAX_ASYNC_OPS || crud_async_ops[op].type == CRUD_ASYNC_FREE)
+		return -1;
+	ao = &crud_async_ops[op];
+	if(ao->done)
+		return 1;
+
+	//every response the operation needs has to be in
+	for(i = 0; i < ao->posted; i++)
+		if(crud_client_poll(ao->tickets[i]) == 0)
+			return 0;
+	if(ao->type == CRUD_ASYNC_READ && ao->count > 0){
+		ra = &crud_read_aheads[ao->fd];
+		for(i = 0; i < ra->count; i++){
+			if(ra->chunks[i].idx >= ao->pos / CRUD_CHUNK_SIZE &&
+			   ra->chunks[i].idx <= (ao->pos + ao->count - 1) / CRUD_CHUNK_SIZE &&
+			   crud_client_poll(ra->chunks[i].ticket) == 0)
+				return 0;
+		}
 	}
+
+	finishAsyncOp(ao);
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_wait
+// Description  : Waits for an asynchronous operation to finish and releases
+//                its completion handle
+//
+// Inputs       : op - the completion handle
+// Outputs      : the result of the operation (as the synchronous call) or -1 if failure
+
+int32_t crud_wait(CrudCompletion op) {
+int32_t ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = waitAsyncOp(op);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
 }
 
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_wait, called with the file system locked
+//IN: see crud_wait
+//Out: see crud_wait
+int32_t waitAsyncOp(CrudCompletion op){
 
+	if(op < 0 || op >= CRUD_MAX_ASYNC_OPS || crud_async_ops[op].type == CRUD_ASYNC_FREE)
+		return -1;
+	finishAsyncOp(&crud_async_ops[op]);
+	crud_async_ops[op].type = CRUD_ASYNC_FREE;
+	return crud_async_ops[op].result;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_seek
-// Description  : Seek to specific point in the file
+// Function     : crud_map
+// Description  : Map a range of the file into memory, the view is a copy of
+//                the file contents (bytes past the end of the file are zeros)
+//                taken now; later writes to the file do not show in it
 //
-// Inputs       : fd - the file descriptor for the file to seek
-//                loc - offset from beginning of file to seek to
+// Inputs       : fd - the file descriptor for the file to map
+//                offset - position of the first byte of the view
+//                length - the number of bytes in the view
+//                flags - CRUD_MAP_READ, or CRUD_MAP_WRITE to write back changes
+// Outputs      : the view or NULL if failure
+
+void *crud_map(int16_t fd, uint32_t offset, uint32_t length, int flags) {
+void *ret;
+
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = mapView(fd, offset, length, flags);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_map, called with the file system locked
+//IN: see crud_map
+//Out: see crud_map
+void *mapView(int16_t fd, uint32_t offset, uint32_t length, int flags){
+CrudMappedView *view;
+int32_t amtRead;
+
+	if(init == 0 || openCheck(fd) || length == 0 || offset + length < offset ||
+	   !(flags & (CRUD_MAP_READ | CRUD_MAP_WRITE)) || (flags & ~(CRUD_MAP_READ | CRUD_MAP_WRITE)))
+		return NULL;
+
+	//take an unused view
+	for(view = crud_views; view < &crud_views[CRUD_MAX_MAPPED_VIEWS] && view->data != NULL; view++);
+	if(view == &crud_views[CRUD_MAX_MAPPED_VIEWS])
+		return NULL;
+
+	//writable views keep the contents they started from to find the changes
+	if((view->data = alloc_crud_pool(length)) == NULL)
+		return NULL;
+	if((flags & CRUD_MAP_WRITE) && (view->clean = alloc_crud_pool(length)) == NULL){
+		free_crud_pool(view->data);
+		view->data = NULL;
+		return NULL;
+	}
+	view->fd = fd;
+	view->offset = offset;
+	view->length = length;
+	view->flags = flags;
+
+	//read in the part of the range inside the file
+	memset(view->data, 0, length);
+	if(flushWriteBuffer(fd) != 0 ||
+	   (fileEntry(fd)->length > offset && readAt(fd, offset, length, view->data, 0, &amtRead) != 0)){
+		free_crud_pool(view->data);
+		free_crud_pool(view->clean);
+		memset(view, 0, sizeof(CrudMappedView));
+		return NULL;
+	}
+	if(view->clean != NULL)
+		memcpy(view->clean, view->data, length);
+	return view->data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_msync
+// Description  : Write the bytes changed in a mapped view back to the file
+//                (nothing for a read only view)
+//
+// Inputs       : view - the view from crud_map
 // Outputs      : 0 if successful or -1 if failure
 
-int32_t crud_seek(int16_t fd, uint32_t loc) {
+int32_t crud_msync(void *view) {
+int32_t ret;
 
-CrudOID ID;
-int32_t length =0;
-int result;
-CrudRequest request;
-CrudResponse response;
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = syncView(view);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_msync, called with the file system locked
+//IN: see crud_msync
+//Out: see crud_msync
+int32_t syncView(void *view){
+CrudMappedView *v;
+
+	if(init == 0 || (v = findView(view)) == NULL)
+		return -1;
+	if(writeBackView(v) != 0 || flushWriteBuffer(v->fd) != 0)
+		return -1;
+	return 0;
+}
 
+////////////////////////////////////////////////////////////////////////////////
 //
-//local variables
+// Function     : crud_unmap_view
+// Description  : Write back the bytes changed in a mapped view and release it
 //
+// Inputs       : view - the view from crud_map
+// Outputs      : 0 if successful or -1 if failure (the view is kept)
 
+int32_t crud_unmap_view(void *view) {
+int32_t ret;
 
-	//check to see if the Crud system is initialized
-	// if not then it initialies the system
-	if(init == 0){
-		request = construct_crud_request(0, CRUD_INIT, 0, 0,0);
-		response = crud_client_operation(request,NULL); 
-		decryptResponse(response,&ID,&length, &result);	
-		if(result!=0)
-			return -1;
-		init = 1;
-    	}
+	pthread_rwlock_wrlock(&crud_io_lock);
+	ret = unmapView(view);
+	pthread_rwlock_unlock(&crud_io_lock);
+	return ret;
+}
 
-	//check to see if file is open
-	if(crud_file_table[fd].open ==0)
+//////////////////////////////////////////////////////////////////////////////////
+//Function : crud_unmap_view, called with the file system locked
+//IN: see crud_unmap_view
+//Out: see crud_unmap_view
+int32_t unmapView(void *view){
+CrudMappedView *v;
+
+	if(syncView(view) != 0)
 		return -1;
+	v = findView(view);
+	free_crud_pool(v->data);
+	free_crud_pool(v->clean);
+	memset(v, 0, sizeof(CrudMappedView));
+	return 0;
+}
 
+// Module local methods
 
-	//update the file position
-	crud_file_table[fd].position = loc;
-	
-	return 0;
+// The file the unit test threads read at once, and what it holds
+int16_t crud_utest_shared_fh;
+char   *crud_utest_shared_data;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudIOUnitTestReader
+// Description  : Unit test thread, reads random ranges of the shared file
+//
+// Inputs       : arg - where to put the result (0 if all reads matched)
+// Outputs      : NULL
+
+void *crudIOUnitTestReader(void *arg) {
 
+	// Local variables
+	char buf[2*CIO_UNIT_TEST_MAX_WRITE_SIZE];
+	uint32_t loc;
+	int32_t count, expected;
+	int i;
+
+	for (i=0; i<CRUD_IO_UNIT_TEST_THREAD_READS; i++) {
+		loc = getRandomValue(0, CRUD_IO_UNIT_TEST_SHARED_LENGTH-1);
+		count = getRandomValue(1, sizeof(buf));
+		expected = (loc+count > CRUD_IO_UNIT_TEST_SHARED_LENGTH) ? CRUD_IO_UNIT_TEST_SHARED_LENGTH-loc : count;
+		if ((crud_pread(crud_utest_shared_fh, buf, count, loc) != expected) ||
+				memcmp(buf, &crud_utest_shared_data[loc], expected)) {
+			*(int *)arg = -1;
+			return(NULL);
+		}
+	}
+	*(int *)arg = 0;
+	return(NULL);
 }
 
-// Module local methods
+// The listing the unit test checks, files left to list before stopping
+int32_t crud_utest_list_limit;
+int crud_utest_list_bad;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudIOUnitTestLister
+// Description  : Unit test listing callback, checks the paths come in order
+//                and each file holds (at least) its path
+//
+// Inputs       : stat - the file listed, arg - the last path listed
+// Outputs      : 0 to go on, 1 to stop the listing
+
+int crudIOUnitTestLister(CrudFileStat *stat, void *arg) {
+
+	// Local variables
+	char *last = arg;
+
+	if ((strcmp(stat->path, last) <= 0) || (stat->length < strlen(stat->path))) {
+		crud_utest_list_bad = 1;
+	}
+	strcpy(last, stat->path);
+	return(--crud_utest_list_limit == 0);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -620,9 +5116,19 @@ int crudIOUnitTest(void) {
 	uint8_t ch;
 	int16_t fh, i;
 	int32_t cio_utest_length, cio_utest_position, count, bytes, expected;
+	int16_t afh[CRUD_IO_UNIT_TEST_ASYNC_FILES];
+	CrudCompletion aop[2*CRUD_IO_UNIT_TEST_ASYNC_FILES];
+	struct iovec iov[3];
+	pthread_t threads[CRUD_IO_UNIT_TEST_THREADS];
+	int tres[CRUD_IO_UNIT_TEST_THREADS];
+	int32_t alen;
 	char *cio_utest_buffer, *tbuf;
 	CRUD_UNIT_TEST_TYPE cmd;
-	char lstr[1024];
+	char lstr[1024], *view;
+	CrudFileStat fstat;
+	CrudResponse response;
+	CrudOID oid;
+	int result;
 
 	// Setup some operating buffers, zero out the mirrored file contents
 	cio_utest_buffer = malloc(CRUD_MAX_OBJECT_SIZE);
@@ -764,14 +5270,18 @@ int crudIOUnitTest(void) {
 		uint32_t length;
 		uint8_t res, flags;
 
-		// Make a fake request to get file handle, then check it
-		request = construct_crud_request(crud_file_table[0].object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, CRUD_NULL_FLAG, 0);
+		// Make a fake request to get the first chunk of the file, then check it
+		if (crud_flush(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : flush failed.");
+			return(-1);
+		}
+		request = construct_crud_request(fileEntry(fh)->chunks[0], CRUD_READ, CRUD_MAX_OBJECT_SIZE, CRUD_NULL_FLAG, 0);
 		response = crud_client_operation(request, tbuf);
 		if ((deconstruct_crud_request(response, &oid, &req, &length, &flags, &res) != 0) || (res != 0))  {
 			logMessage(LOG_ERROR_LEVEL, "Read failure, bad CRUD response [%x]", response);
 			return(-1);
 		}
-		if ( (cio_utest_length != length) || (memcmp(cio_utest_buffer, tbuf, length)) ) {
+		if ( (chunkCapacity(0, cio_utest_length) != length) || (memcmp(cio_utest_buffer, tbuf, chunkLength(0, cio_utest_length))) ) {
 			logMessage(LOG_ERROR_LEVEL, "Buffer/Object cross validation failed [%x]", response);
 			bufToString((unsigned char *)tbuf, length, (unsigned char *)lstr, 1024 );
 			logMessage(LOG_INFO_LEVEL, "CIO_UTEST VR: %s", lstr);
@@ -792,8 +5302,6 @@ int crudIOUnitTest(void) {
 		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure read comparison block.", fh);
 		return(-1);
 	}
-	free(cio_utest_buffer);
-	free(tbuf);
 
 	// Format and mount the file system
 	if (crud_unmount()) {
@@ -801,6 +5309,460 @@ int crudIOUnitTest(void) {
 		return(-1);
 	}
 
+	// Now fill several pages of the file table, each file holding its name
+	// (enough files for the path index to grow its buckets), then open each
+	// again, every one must be found
+	if (crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on mount operation.");
+		return(-1);
+	}
+	for (i=0; i<CRUD_IO_UNIT_TEST_TABLE_FILES; i++) {
+		sprintf(lstr, "table_file_%d.txt", i);
+		count = strlen(lstr);
+		if (((fh = crud_open(lstr)) == -1) || (crud_write(fh, lstr, count) != count) || crud_close(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure creating table file [%s].", lstr);
+			return(-1);
+		}
+	}
+	expected = crud_table_root.files;
+	for (i=0; i<CRUD_IO_UNIT_TEST_TABLE_FILES; i++) {
+		sprintf(lstr, "table_file_%d.txt", i);
+		count = strlen(lstr);
+		if (((fh = crud_open(lstr)) == -1) || (crud_read(fh, tbuf, CRUD_MAX_PATH_LENGTH) != count) ||
+				memcmp(tbuf, lstr, count) || crud_close(fh) || (crud_table_root.files != (uint32_t)expected)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Table file [%s] not found again.", lstr);
+			return(-1);
+		}
+	}
+
+	// Sync the table, change a file, then remount (reading the table back from
+	// its pages, their OIDs from the page list)
+	fh = crud_open("table_file_0.txt");
+	if (crud_sync() || (fh == -1) || crud_seek(fh, 0) || (crud_write(fh, "T", 1) != 1) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on table sync.");
+		return(-1);
+	}
+	if (crud_unmount() || crud_mount() || (crud_table_root.page_lists[0].count != crud_table_root.pages) ||
+			(crud_table_root.page_lists[1].oid != CRUD_NO_OBJECT)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on table remount.");
+		return(-1);
+	}
+
+	// Opening a file reads in only the page it is in (the path directory says
+	// which), no checksum shard is read until an object in it is
+	sprintf(lstr, "table_file_%d.txt", CRUD_IO_UNIT_TEST_TABLE_FILES/2);
+	if (((fh = crud_open(lstr)) == -1) || (crud_table_pages_loaded != 1) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Opening [%s] read in %u table pages.", lstr, crud_table_pages_loaded);
+		return(-1);
+	}
+	for (i=0; i<CRUD_CHECKSUM_SHARDS; i++) {
+		if (crud_checksum_shards[i].loaded) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Checksum shard %d read in at mount.", i);
+			return(-1);
+		}
+	}
+	for (i=CRUD_IO_UNIT_TEST_TABLE_FILES-1; i>=0; i--) {
+		sprintf(lstr, "table_file_%d.txt", i);
+		count = strlen(lstr);
+		if (((fh = crud_open(lstr)) == -1) || (crud_read(fh, tbuf, CRUD_MAX_PATH_LENGTH) != count) || crud_close(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Table file [%s] unreadable after remount.", lstr);
+			return(-1);
+		}
+		if (i == 0) {
+			lstr[0] = 'T'; // Changed after the sync
+		}
+		if (memcmp(tbuf, lstr, count) || (crud_table_root.files != (uint32_t)expected)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Table file [%s] mismatch after remount.", lstr);
+			return(-1);
+		}
+	}
+
+	// The table files are held inline, growing one moves it to a slab shared
+	// with other small files, growing it past the limit moves it to its own chunk
+	fh = crud_open("table_file_1.txt");
+	i = crud_open("table_file_2.txt");
+	if ((fh == -1) || (i == -1) || !inlineFile(fileEntry(fh)) || crud_seek(fh, CRUD_MAX_INLINE_LENGTH) ||
+			(crud_write(fh, "X", 1) != 1) || crud_seek(i, CRUD_MAX_INLINE_LENGTH) || (crud_write(i, "X", 1) != 1) ||
+			crud_flush(fh) || crud_flush(i) || (fileEntry(fh)->slab == CRUD_NO_OBJECT) || (fileEntry(fh)->slab != fileEntry(i)->slab) ||
+			crud_seek(fh, CRUD_MAX_PACKED_LENGTH) || (crud_write(fh, "X", 1) != 1) || crud_flush(fh) ||
+			(fileEntry(fh)->slab != CRUD_NO_OBJECT) || (fileEntry(fh)->chunks[0] == CRUD_NO_OBJECT) || crud_seek(fh, 0) ||
+			(crud_read(fh, tbuf, CRUD_MAX_PATH_LENGTH) != CRUD_MAX_PATH_LENGTH) || memcmp(tbuf, "table_file_1.txt", 17) ||
+			(tbuf[CRUD_MAX_INLINE_LENGTH] != 'X') || (tbuf[CRUD_MAX_INLINE_LENGTH-1] != 0) || crud_close(fh) || crud_close(i)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on inline/packed table files.");
+		return(-1);
+	}
+
+	// Write several files at once asynchronously, then read them all back the same way
+	for (bytes=0; bytes<CRUD_MAX_OBJECT_SIZE; bytes++) {
+		cio_utest_buffer[bytes] = (char)(bytes ^ (bytes >> 9));
+	}
+	for (i=0; i<CRUD_IO_UNIT_TEST_ASYNC_FILES; i++) {
+		sprintf(lstr, "async_file_%d.txt", i);
+		alen = (i+1) * CRUD_CHUNK_SIZE / 5;
+		if (((afh[i] = crud_open(lstr)) == -1) ||
+				((aop[2*i] = crud_write_async(afh[i], &cio_utest_buffer[i*1000], alen)) == -1) ||
+				((aop[2*i+1] = crud_flush_async(afh[i])) == -1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure starting async write [%s].", lstr);
+			return(-1);
+		}
+	}
+	for (i=0; i<CRUD_IO_UNIT_TEST_ASYNC_FILES; i++) {
+		if ((crud_wait(aop[2*i]) != (i+1) * CRUD_CHUNK_SIZE / 5) || (crud_wait(aop[2*i+1]) != 0) || crud_seek(afh[i], 0) ||
+				((aop[i] = crud_read_async(afh[i], &tbuf[i*(CRUD_MAX_OBJECT_SIZE/CRUD_IO_UNIT_TEST_ASYNC_FILES)], CRUD_CHUNK_SIZE*2)) == -1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on async write of file %d.", i);
+			return(-1);
+		}
+	}
+	for (i=0, count=0; count<CRUD_IO_UNIT_TEST_ASYNC_FILES; i=(i+1)%CRUD_IO_UNIT_TEST_ASYNC_FILES) {
+		if ((aop[i] == -1) || (crud_poll(aop[i]) == 0)) {
+			continue;
+		}
+		alen = (i+1) * CRUD_CHUNK_SIZE / 5;
+		if ((crud_wait(aop[i]) != alen) || memcmp(&tbuf[i*(CRUD_MAX_OBJECT_SIZE/CRUD_IO_UNIT_TEST_ASYNC_FILES)], &cio_utest_buffer[i*1000], alen) ||
+				crud_close(afh[i])) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Async read mismatch on file %d.", i);
+			return(-1);
+		}
+		aop[i] = -1;
+		count++;
+	}
+
+	// Start a read of a packed file, change another file in the same slab
+	// before it finishes, the slab read for the first must not hide the change
+	alen = CRUD_MAX_INLINE_LENGTH + 100;
+	fh = crud_open("slab_file_a.txt");
+	i = crud_open("slab_file_b.txt");
+	if ((fh == -1) || (i == -1) || (crud_write(fh, cio_utest_buffer, alen) != alen) || (crud_write(i, cio_utest_buffer, alen) != alen) ||
+			crud_close(fh) || crud_close(i) || crud_unmount() || crud_mount() ||
+			((fh = crud_open("slab_file_a.txt")) == -1) || ((i = crud_open("slab_file_b.txt")) == -1) ||
+			(fileEntry(fh)->slab == CRUD_NO_OBJECT) || (fileEntry(fh)->slab != fileEntry(i)->slab) ||
+			((aop[0] = crud_read_async(fh, tbuf, alen)) == -1) || (crud_write(i, "CHANGED", 7) != 7) || crud_flush(i) ||
+			(crud_wait(aop[0]) != alen) || memcmp(tbuf, cio_utest_buffer, alen) || crud_seek(i, 0) ||
+			(crud_read(i, tbuf, alen) != alen) || memcmp(tbuf, "CHANGED", 7) || memcmp(&tbuf[7], &cio_utest_buffer[7], alen - 7) ||
+			crud_close(fh) || crud_close(i)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Stale slab read after write to a packed file.");
+		return(-1);
+	}
+	aop[0] = -1;
+
+	// Write a file from three pieces, read it back into two
+	iov[0].iov_base = cio_utest_buffer;
+	iov[0].iov_len = 16;
+	iov[1].iov_base = &cio_utest_buffer[16];
+	iov[1].iov_len = CRUD_CHUNK_SIZE + 4000;
+	iov[2].iov_base = &cio_utest_buffer[16 + CRUD_CHUNK_SIZE + 4000];
+	iov[2].iov_len = 5;
+	alen = 16 + CRUD_CHUNK_SIZE + 4000 + 5;
+	if (((fh = crud_open("vector_file.txt")) == -1) || (crud_writev(fh, iov, 3) != alen) || crud_seek(fh, 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on vectored write.");
+		return(-1);
+	}
+	iov[0].iov_base = tbuf;
+	iov[0].iov_len = CRUD_CHUNK_SIZE - 100;
+	iov[1].iov_base = &tbuf[CRUD_CHUNK_SIZE - 100];
+	iov[1].iov_len = CRUD_CHUNK_SIZE;
+	if ((crud_readv(fh, iov, 2) != alen) || memcmp(tbuf, cio_utest_buffer, alen)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on vectored read.");
+		return(-1);
+	}
+
+	// Buffers adding up to more than a count can hold are refused before anything is done
+	iov[0].iov_len = INT32_MAX;
+	iov[1].iov_len = 1;
+	if ((crud_writev(fh, iov, 2) != -1) || (crud_readv(fh, iov, 2) != -1) || crud_seek(fh, 0) ||
+			(crud_read(fh, tbuf, 2*CRUD_CHUNK_SIZE) != alen) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on oversized vectored read/write.");
+		return(-1);
+	}
+
+	// Write a file back to front with positional writes, then read it from several threads at once
+	crud_utest_shared_data = cio_utest_buffer;
+	if ((crud_utest_shared_fh = crud_open("shared_file.txt")) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure opening shared file.");
+		return(-1);
+	}
+	for (bytes=CRUD_IO_UNIT_TEST_SHARED_LENGTH; bytes>0; bytes-=count) {
+		count = (bytes < 3000) ? bytes : 3000;
+		if (crud_pwrite(crud_utest_shared_fh, &cio_utest_buffer[bytes-count], count, bytes-count) != count) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on positional write.");
+			return(-1);
+		}
+	}
+	crud_flush(crud_utest_shared_fh);
+	for (i=0; i<CRUD_IO_UNIT_TEST_THREADS; i++) {
+		if (pthread_create(&threads[i], NULL, crudIOUnitTestReader, &tres[i])) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure starting reader thread.");
+			return(-1);
+		}
+	}
+	for (i=0, count=0; i<CRUD_IO_UNIT_TEST_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		count |= tres[i];
+	}
+	if (count || crud_close(crud_utest_shared_fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on threaded positional reads.");
+		return(-1);
+	}
+
+	// Map a file (and some bytes past its end), change scattered bytes, check they get written back
+	alen = 2*CRUD_CHUNK_SIZE + 300;
+	memset(&cio_utest_buffer[alen], 0x0, 500);
+	if (((fh = crud_open("mapped_file.txt")) == -1) || (crud_write(fh, cio_utest_buffer, alen) != alen) ||
+			((view = crud_map(fh, 1000, alen-500, CRUD_MAP_READ|CRUD_MAP_WRITE)) == NULL) ||
+			memcmp(view, &cio_utest_buffer[1000], alen-1000) || memcmp(&view[alen-1000], &cio_utest_buffer[alen], 500)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure mapping file.");
+		return(-1);
+	}
+	for (i=0; i<2; i++) {
+		for (count=0; count<64; count++) {
+			bytes = getRandomValue(0, alen-501);
+			view[bytes] ^= 0x5a;
+			cio_utest_buffer[1000+bytes] = view[bytes];
+		}
+		view[alen-501-i*100] = 1;
+		cio_utest_buffer[alen+499-i*100] = 1;
+		if (((i == 0) ? crud_msync(view) : crud_unmap_view(view)) || (crud_pread(fh, tbuf, alen+500, 0) != alen+500) ||
+				memcmp(tbuf, cio_utest_buffer, alen+500)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Mapped view not written back (pass %d).", i);
+			return(-1);
+		}
+	}
+	if (((view = crud_map(fh, 0, alen+500, CRUD_MAP_READ)) == NULL) || memcmp(view, cio_utest_buffer, alen+500)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on read only mapped view.");
+		return(-1);
+	}
+	view[0]++;
+	if (crud_unmap_view(view) || (crud_pread(fh, tbuf, 1, 0) != 1) || (tbuf[0] != cio_utest_buffer[0]) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Read only mapped view written back.");
+		return(-1);
+	}
+
+	// Write a compressed file, check its chunk objects shrink on the server and
+	// that it reads back (whole and in part) after a change and without the cache
+	for (alen=0, bytes=0; alen<2*CRUD_CHUNK_SIZE+1000; bytes++) {
+		alen += sprintf(&cio_utest_buffer[alen], "line %d of the compressed file\n", bytes);
+	}
+	if (((fh = crud_open("compressed_file.txt")) == -1) || crud_compress(fh) ||
+			(crud_write(fh, cio_utest_buffer, alen) != alen) || crud_flush(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure writing compressed file.");
+		return(-1);
+	}
+	response = crud_client_operation(construct_crud_request(fileEntry(fh)->chunks[0], CRUD_READ, CRUD_CHUNK_SIZE, 0, 0), tbuf);
+	decryptResponse(response, &oid, &count, &result);
+	if (result || !compressedResponse(response) || (count > CRUD_CHUNK_SIZE/2)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Compressed file chunk stored as %d bytes.", count);
+		return(-1);
+	}
+	memcpy(&cio_utest_buffer[CRUD_CHUNK_SIZE-10], "a change across chunks", 22);
+	if (crud_seek(fh, CRUD_CHUNK_SIZE-10) || (crud_write(fh, "a change across chunks", 22) != 22) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure changing compressed file.");
+		return(-1);
+	}
+	close_crud_cache();
+	if (((fh = crud_open("compressed_file.txt")) == -1) || (crud_pread(fh, tbuf, 100, CRUD_CHUNK_SIZE-50) != 100) ||
+			memcmp(tbuf, &cio_utest_buffer[CRUD_CHUNK_SIZE-50], 100) || (crud_read(fh, tbuf, alen) != alen) ||
+			memcmp(tbuf, cio_utest_buffer, alen) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Compressed file mismatch.");
+		return(-1);
+	}
+
+	// Write the same contents to two files, they must share their chunk objects;
+	// changing either one (before and after a remount) must leave the other alone
+	alen = 2*CRUD_CHUNK_SIZE + 500;
+	if (((fh = crud_open("dedup_file_1.txt")) == -1) || ((i = crud_open("dedup_file_2.txt")) == -1) ||
+			(crud_write(fh, cio_utest_buffer, alen) != alen) || (crud_write(i, cio_utest_buffer, alen) != alen) ||
+			crud_flush(fh) || crud_flush(i) || (fileEntry(fh)->chunks[0] != fileEntry(i)->chunks[0]) ||
+			(fileEntry(fh)->chunks[1] != fileEntry(i)->chunks[1]) || (fileEntry(fh)->chunks[2] != fileEntry(i)->chunks[2]) ||
+			crud_seek(i, 100) || (crud_write(i, "changed", 7) != 7) || crud_flush(i) ||
+			(fileEntry(fh)->chunks[0] == fileEntry(i)->chunks[0]) || (fileEntry(fh)->chunks[1] != fileEntry(i)->chunks[1]) ||
+			crud_seek(fh, 0) || (crud_read(fh, tbuf, alen) != alen) || memcmp(tbuf, cio_utest_buffer, alen) ||
+			crud_close(fh) || crud_close(i) || crud_unmount() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on deduplicated files.");
+		return(-1);
+	}
+	if (((fh = crud_open("dedup_file_1.txt")) == -1) || ((i = crud_open("dedup_file_2.txt")) == -1) ||
+			(fileEntry(fh)->chunks[1] != fileEntry(i)->chunks[1]) || crud_seek(fh, CRUD_CHUNK_SIZE) ||
+			(crud_write(fh, "changed", 7) != 7) || crud_flush(fh) || (fileEntry(fh)->chunks[1] == fileEntry(i)->chunks[1]) ||
+			(crud_read(i, tbuf, alen) != alen) || memcmp(tbuf, cio_utest_buffer, 100) || memcmp(&tbuf[100], "changed", 7) ||
+			memcmp(&tbuf[107], &cio_utest_buffer[107], alen-107) || crud_close(fh) || crud_close(i)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on deduplicated files after remount.");
+		return(-1);
+	}
+
+	// Change a chunk object behind the back of the file system, reading it must fail
+	if (((fh = crud_open("checksum_file.txt")) == -1) || (crud_write(fh, &cio_utest_buffer[7], CRUD_CHUNK_SIZE) != CRUD_CHUNK_SIZE) ||
+			crud_flush(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure writing checksum file.");
+		return(-1);
+	}
+	response = crud_client_operation(construct_crud_request(fileEntry(fh)->chunks[0], CRUD_READ, CRUD_CHUNK_SIZE, 0, 0), tbuf);
+	decryptResponse(response, &oid, &count, &result);
+	tbuf[count/2] ^= 0x10;
+	response = crud_client_operation(construct_crud_request(fileEntry(fh)->chunks[0], CRUD_UPDATE, count,
+			(compressedResponse(response)) ? CRUD_COMPRESSED_OBJECT : 0, 0), tbuf);
+	decryptResponse(response, &oid, &count, &result);
+	close_crud_cache();
+	if (result || crud_seek(fh, 0) || (crud_read(fh, tbuf, CRUD_CHUNK_SIZE) != -1) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Changed chunk object not detected.");
+		return(-1);
+	}
+
+	// Cut a file (sharing its chunks with another) down across chunks: the last
+	// chunk object shrinks, the other file is left alone and zero filling the
+	// file out again reads back zeros past the cut
+	alen = 5*CRUD_CHUNK_SIZE + 777;
+	count = 2*CRUD_CHUNK_SIZE + 100;
+	if (((fh = crud_open("truncate_file.txt")) == -1) || ((i = crud_open("truncate_copy.txt")) == -1) ||
+			(crud_write(fh, cio_utest_buffer, alen) != alen) || (crud_write(i, cio_utest_buffer, alen) != alen) ||
+			crud_flush(i) || crud_truncate(fh, count) || (fileEntry(fh)->chunks[3] != CRUD_NO_OBJECT) ||
+			(fileEntry(fh)->chunks[1] != fileEntry(i)->chunks[1]) || (fileEntry(fh)->chunks[2] == fileEntry(i)->chunks[2])) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure truncating file.");
+		return(-1);
+	}
+	response = crud_client_operation(construct_crud_request(fileEntry(fh)->chunks[2], CRUD_READ, CRUD_CHUNK_SIZE, 0, 0), tbuf);
+	decryptResponse(response, &oid, &bytes, &result);
+	if (result || (bytes > chunkCapacity(2, count))) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Truncated chunk object is %d bytes.", bytes);
+		return(-1);
+	}
+	close_crud_cache();
+	if (crud_seek(i, 0) || (crud_read(i, tbuf, alen) != alen) || memcmp(tbuf, cio_utest_buffer, alen) || crud_close(i)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : File sharing chunks with a truncated one changed.");
+		return(-1);
+	}
+	memset(&cio_utest_buffer[count], 0x0, 3*CRUD_CHUNK_SIZE - count);
+	if (crud_truncate(fh, 3*CRUD_CHUNK_SIZE) || crud_seek(fh, 0) || (crud_read(fh, tbuf, alen) != 3*CRUD_CHUNK_SIZE) ||
+			memcmp(tbuf, cio_utest_buffer, 3*CRUD_CHUNK_SIZE)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Truncated file mismatch after zero fill.");
+		return(-1);
+	}
+
+	// Its last chunk is its own now, cut it again (in place) then all the way down
+	if (crud_truncate(fh, count-90)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure truncating file again.");
+		return(-1);
+	}
+	close_crud_cache();
+	if (crud_seek(fh, 0) || (crud_read(fh, tbuf, alen) != count-90) || memcmp(tbuf, cio_utest_buffer, count-90) ||
+			crud_truncate(fh, 10) || crud_seek(fh, 0) || (crud_read(fh, tbuf, alen) != 10) || memcmp(tbuf, cio_utest_buffer, 10) ||
+			crud_truncate(fh, 0) || !inlineFile(fileEntry(fh)) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Truncated file mismatch.");
+		return(-1);
+	}
+
+	// Then a packed file and a tiny one
+	for (i=0; i<2; i++) {
+		alen = (i == 0) ? 3000 : 50;
+		sprintf(lstr, "truncate_small_%d.txt", i);
+		if (((fh = crud_open(lstr)) == -1) || (crud_write(fh, cio_utest_buffer, alen) != alen) ||
+				crud_truncate(fh, alen/3) || crud_truncate(fh, 2*alen/3)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure truncating file [%s].", lstr);
+			return(-1);
+		}
+		memset(&cio_utest_buffer[alen/3], 0x0, 2*alen/3 - alen/3);
+		close_crud_cache();
+		if (crud_seek(fh, 0) || (crud_read(fh, tbuf, alen) != 2*alen/3) || memcmp(tbuf, cio_utest_buffer, 2*alen/3) ||
+				crud_close(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Truncated file [%s] mismatch.", lstr);
+			return(-1);
+		}
+	}
+
+	// Clone a file with a chunk in the dedup index and one changed in place
+	// (so not): the clone shares the first, changing either file leaves the
+	// other alone, cloning a tiny file over the clone replaces it
+	for (alen=0, bytes=0; alen<3*CRUD_CHUNK_SIZE+1000; bytes++) {
+		alen += sprintf(&cio_utest_buffer[alen], "line %d of the clone source\n", bytes);
+	}
+	memcpy(&cio_utest_buffer[CRUD_CHUNK_SIZE+5], "in place", 8);
+	if (((fh = crud_open("clone_source.txt")) == -1) || (crud_write(fh, cio_utest_buffer, alen) != alen) ||
+			crud_flush(fh) || crud_seek(fh, CRUD_CHUNK_SIZE+5) || (crud_write(fh, "in place", 8) != 8) ||
+			crud_clone("clone_source.txt", "clone_file.txt") || ((i = crud_open("clone_file.txt")) == -1) ||
+			(fileEntry(i)->chunks[0] != fileEntry(fh)->chunks[0]) || (crud_read(i, tbuf, alen+100) != alen) ||
+			memcmp(tbuf, cio_utest_buffer, alen)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure cloning file.");
+		return(-1);
+	}
+	if (crud_seek(i, CRUD_CHUNK_SIZE+5) || (crud_write(i, "changed", 7) != 7) || crud_seek(fh, 10) ||
+			(crud_write(fh, "changed", 7) != 7) || crud_flush(i) || crud_flush(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure changing cloned file.");
+		return(-1);
+	}
+	close_crud_cache();
+	if (crud_seek(fh, 0) || (crud_read(fh, tbuf, alen) != alen) || memcmp(tbuf, cio_utest_buffer, 10) ||
+			memcmp(&tbuf[10], "changed", 7) || memcmp(&tbuf[17], &cio_utest_buffer[17], alen-17) ||
+			crud_seek(i, 0) || (crud_read(i, tbuf, alen) != alen) || memcmp(tbuf, cio_utest_buffer, CRUD_CHUNK_SIZE+5) ||
+			memcmp(&tbuf[CRUD_CHUNK_SIZE+5], "changed", 7) || memcmp(&tbuf[CRUD_CHUNK_SIZE+12], &cio_utest_buffer[CRUD_CHUNK_SIZE+12], alen-CRUD_CHUNK_SIZE-12)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Cloned files not independent.");
+		return(-1);
+	}
+	if (crud_clone("table_file_3.txt", "clone_file.txt") || crud_seek(i, 0) || (crud_read(i, tbuf, alen) != 16) ||
+			memcmp(tbuf, "table_file_3.txt", 16) || crud_close(i) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure cloning over a file.");
+		return(-1);
+	}
+
+	// Stat and list the table files after a remount: a missing path gets no
+	// slot, a file created after the first listing is merged into the next,
+	// an open file reports its buffered writes, the callback can stop early
+	if (crud_unmount() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on list remount.");
+		return(-1);
+	}
+
+	// The name filter read at mount rules out a missing path without reading
+	// a page and holds every path, one out of date is built by the first miss
+	if ((crud_name_filter == NULL) || (crud_stat("table_file_none.txt", &fstat) != -1) || (crud_table_pages_loaded != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on name filter lookup.");
+		return(-1);
+	}
+	for (i=0; i<CRUD_IO_UNIT_TEST_TABLE_FILES; i++) {
+		sprintf(lstr, "table_file_%d.txt", i);
+		if (!inNameFilter(lstr)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Path [%s] missing from name filter.", lstr);
+			return(-1);
+		}
+	}
+	resetNameFilter();
+	if ((crud_stat("table_file_none.txt", &fstat) != -1) || (crud_name_filter == NULL) || !inNameFilter("table_file_7.txt")) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure rebuilding name filter.");
+		return(-1);
+	}
+	expected = crud_table_root.files;
+	lstr[0] = '\0';
+	crud_utest_list_limit = -1;
+	crud_utest_list_bad = 0;
+	if ((crud_stat("table_file_none.txt", &fstat) != -1) || (crud_table_root.files != (uint32_t)expected) ||
+			crud_stat("table_file_7.txt", &fstat) || (fstat.length != 16) || strcmp(fstat.path, "table_file_7.txt") ||
+			(crud_list("table_file_", crudIOUnitTestLister, lstr) != CRUD_IO_UNIT_TEST_TABLE_FILES) || crud_utest_list_bad) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on stat or list.");
+		return(-1);
+	}
+	if (((fh = crud_open("table_file_new.txt")) == -1) || (crud_write(fh, "table_file_new.txt", 18) != 18) ||
+			crud_stat("table_file_new.txt", &fstat) || (fstat.length != 18)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on stat of open file.");
+		return(-1);
+	}
+	lstr[0] = '\0';
+	if ((crud_list("table_file_", crudIOUnitTestLister, lstr) != CRUD_IO_UNIT_TEST_TABLE_FILES+1) || crud_utest_list_bad ||
+			(crud_list("table_file_z", crudIOUnitTestLister, lstr) != 0) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure listing new file.");
+		return(-1);
+	}
+	lstr[0] = '\0';
+	crud_utest_list_limit = 100;
+	if ((crud_list("table_file_", crudIOUnitTestLister, lstr) != 100) || crud_utest_list_bad) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure stopping listing.");
+		return(-1);
+	}
+
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
+	}
+	free(cio_utest_buffer);
+	free(tbuf);
+
 	// Return successfully
 	return(0);
 }
@@ -13,25 +13,100 @@
 
 // Include files
 #include <stdint.h>
+#include <sys/uio.h>
 
 // Project include files
 #include <crud_driver.h>
 
 // Defines
-#define CRUD_MAX_TOTAL_FILES 1024
+#define CRUD_MAX_OPEN_FILES 1024    // Number of files that can be open at once
+#define CRUD_FILES_PER_PAGE 256     // Number of file table entries in each table page object
+#define CRUD_MAX_TABLE_PAGES 16384  // Number of table pages the root can list
+#define CRUD_PAGE_LIST_PAGES 1024   // Number of page OIDs in each page list object
+#define CRUD_MAX_PAGE_LISTS (CRUD_MAX_TABLE_PAGES/CRUD_PAGE_LIST_PAGES)
+#define CRUD_PATH_DIRECTORY_BUCKETS 128 // Number of path directory bucket objects (power of 2)
+#define CRUD_CHECKSUM_SHARDS 64     // Number of checksum index shard objects (power of 2)
+#define CRUD_MAX_TOTAL_FILES (CRUD_FILES_PER_PAGE*CRUD_MAX_TABLE_PAGES)
 #define CRUD_MAX_PATH_LENGTH 128
+#define CRUD_CHUNK_SIZE 0x10000  // Size of each chunk object of a file
+#define CRUD_DIRECT_CHUNKS 4     // Number of chunks kept in the file table entry
+#define CRUD_SLAB_SIZE CRUD_CHUNK_SIZE // Size of the slab objects small files are packed into
+#define CRUD_MAX_PACKED_LENGTH 4096    // Largest file kept in a slab rather than its own chunks
+#define CRUD_MAX_INLINE_LENGTH 64      // Largest file kept in its file table entry
+#define CRUD_MAX_ASYNC_OPS 256   // Number of asynchronous operations that can be outstanding
+#define CRUD_MAX_MAPPED_VIEWS 64 // Number of mapped views that can exist at once
+#define CRUD_MAP_READ  0x1       // Mapped view holds the file contents (read only)
+#define CRUD_MAP_WRITE 0x2       // Mapped view changes are written back to the file
+#define CRUD_FILE_COMPRESSED 0x1 // File entry flag: chunk objects are stored compressed
 
 // Type definitions
 
-// This is the basic file handle structure (note: index into file table is fh)
+// This is the basic file table entry (one per file, file handles refer to it).
+// The file is stored as CRUD_CHUNK_SIZE chunk objects; chunk i holds bytes
+// [i*CRUD_CHUNK_SIZE, (i+1)*CRUD_CHUNK_SIZE) and a chunk of 0 is a hole (zeros).
+// A small file is packed instead: its one chunk is a range of a shared slab
+// object starting at slab_offset, and it has no chunk objects of its own.
+// A tiny file (no slab, no chunk 0) is held in the entry itself.  The chunk
+// objects of a file flagged CRUD_FILE_COMPRESSED are stored compressed (each
+// object carries the CRUD_COMPRESSED_OBJECT flag if it actually is).
 typedef struct {
 	char      filename[CRUD_MAX_PATH_LENGTH]; // The filename of the data to be manipulated
-	CrudOID   object_id;                      // The handle of the object
-	uint32_t  position;                       // This is the position of the file
+	CrudOID   chunks[CRUD_DIRECT_CHUNKS];     // The objects holding the first chunks
+	CrudOID   extent_map;                     // Object listing the OIDs of the remaining chunks
 	uint32_t  length;                         // This is the length of the file
-	uint8_t   open;                           // Flag indicating the file is currently open
+	CrudOID   slab;                           // The slab holding the file if packed (0 if not)
+	uint32_t  slab_offset;                    // Position of the file in the slab
+	uint32_t  flags;                          // CRUD_FILE_* flags of the file
+	char      contents[CRUD_MAX_INLINE_LENGTH]; // The data of a tiny file (zeros past its end)
 } CrudFileAllocationType;
 
+// This is the completion handle of an asynchronous operation
+typedef int32_t CrudCompletion;
+
+// This is what crud_stat and crud_list report about a file
+typedef struct {
+	char      path[CRUD_MAX_PATH_LENGTH]; // The path of the file
+	uint32_t  length;                     // The length of the file (including buffered writes)
+	uint32_t  flags;                      // CRUD_FILE_* flags of the file
+} CrudFileStat;
+
+// This is called by crud_list for each file listed (a non-zero return stops the listing)
+typedef int (*CrudListCallback)(CrudFileStat *stat, void *arg);
+
+// This is an object of records listed in the root of the file table
+typedef struct {
+	CrudOID   oid;   // The object (0 if none)
+	uint32_t  count; // Number of records in the object
+} CrudIndexRef;
+
+// This is the root of the file table, stored in the priority object.  The
+// entries live in page objects of CRUD_FILES_PER_PAGE entries each, entry n
+// is in page n/CRUD_FILES_PER_PAGE.  The OIDs of the pages are kept in page
+// list objects of CRUD_PAGE_LIST_PAGES each, so the root stays the same
+// small size however many files there are.  The path directory says which
+// slot each path hash is in, its records are spread over bucket objects by
+// hash, so finding a path reads its bucket and the page it is in.  Chunk objects holding the same contents
+// are shared by the files writing them, the dedup index object lists them.
+// The checksum index holds the CRC32C of the contents of the chunk objects
+// (and slabs) the client last wrote whole or knew all of, split over shard
+// objects by OID, each read in when an object in it is first needed.  The name
+// filter object is a Bloom filter of the paths in the table, so a path that
+// is not there is known not to be without reading the pages.
+typedef struct {
+	uint32_t  files;                          // Number of entries in use
+	uint32_t  pages;                          // Number of pages in the table
+	CrudOID   slab;                           // The slab new small files are packed into
+	uint32_t  slab_used;                      // Number of bytes of the slab given out
+	CrudOID   dedup_index;                    // Object holding the dedup index (0 if none)
+	uint32_t  dedup_entries;                  // Number of slots in the dedup index object (unused ones have no OID)
+	CrudOID   name_filter;                    // Object holding the name filter (0 if none)
+	uint32_t  name_filter_length;             // Size of the name filter object
+	uint32_t  name_filter_files;              // Number of entries in use when it was written
+	CrudIndexRef page_lists[CRUD_MAX_PAGE_LISTS]; // The objects listing the OIDs of the pages
+	CrudIndexRef path_directory[CRUD_PATH_DIRECTORY_BUCKETS]; // The path directory bucket objects
+	CrudIndexRef checksum_shards[CRUD_CHECKSUM_SHARDS]; // The checksum index shard objects (OID modulo)
+} CrudFileTableRoot;
+
 //
 // Management operations
 
@@ -44,6 +119,9 @@ uint16_t crud_mount(void);
 uint16_t crud_unmount(void);
 	// This function unmounts the current crud file system and saves the file allocation table.
 
+uint16_t crud_sync(void);
+	// This function saves the changed parts of the file allocation table (stays mounted).
+
 //
 // Interface functions
 
@@ -59,9 +137,77 @@ int32_t crud_read(int16_t fd, void *buf, int32_t count);
 int32_t crud_write(int16_t fd, void *buf, int32_t count);
 	// Writes "count" bytes to the file handle "fh" from the buffer  "buf"
 
+int32_t crud_readv(int16_t fd, const struct iovec *iov, int iovcnt);
+	// Reads into each of the "iovcnt" buffers of "iov" in turn, as one read
+
+int32_t crud_writev(int16_t fd, const struct iovec *iov, int iovcnt);
+	// Writes each of the "iovcnt" buffers of "iov" in turn, as one write
+
+int32_t crud_pread(int16_t fd, void *buf, int32_t count, uint32_t loc);
+	// Reads "count" bytes at "loc" into the buffer "buf" (file position unchanged, thread safe)
+
+int32_t crud_pwrite(int16_t fd, void *buf, int32_t count, uint32_t loc);
+	// Writes "count" bytes at "loc" from the buffer "buf" (file position unchanged, thread safe)
+
 int32_t crud_seek(int16_t fd, uint32_t loc);
 	// Seek to specific point in the file
 
+int32_t crud_flush(int16_t fd);
+	// Write out the writes to the file that are still buffered
+
+int32_t crud_compress(int16_t fd);
+	// Store the chunk objects of the file compressed from now on
+
+int32_t crud_truncate(int16_t fd, uint32_t length);
+	// Cut the file down (or zero fill it out) to "length" bytes
+
+int32_t crud_clone(char *src, char *dst);
+	// Make the file "dst" a copy of the file "src" (sharing its chunk objects)
+
+int32_t crud_stat(char *path, CrudFileStat *stat);
+	// Get the length and flags of the file "path" without opening it (-1 if there is no such file)
+
+int32_t crud_list(char *prefix, CrudListCallback cb, void *arg);
+	// Call "cb" for each file whose path starts with "prefix" in path order, returns the number listed
+
+//
+// Asynchronous interface functions (operations on a file take effect in the
+// order they are started, the result is what the synchronous call returns)
+
+CrudCompletion crud_read_async(int16_t fd, void *buf, int32_t count);
+	// Start reading "count" bytes from the file handle into "buf" (which must stay valid)
+
+CrudCompletion crud_write_async(int16_t fd, void *buf, int32_t count);
+	// Start writing "count" bytes to the file handle from "buf"
+
+CrudCompletion crud_flush_async(int16_t fd);
+	// Start writing out the writes to the file that are still buffered
+
+int crud_poll(CrudCompletion op);
+	// Check if an asynchronous operation has finished (1 if finished, 0 if not, -1 if failure)
+
+int32_t crud_wait(CrudCompletion op);
+	// Wait for an asynchronous operation and release its handle, returns its result
+
+//
+// Mapped view functions (a view is a local copy of a range of the file, the
+// bytes changed in a writable view go back to the file on crud_msync, on
+// crud_unmap_view and when the file is closed)
+
+void *crud_map(int16_t fd, uint32_t offset, uint32_t length, int flags);
+	// Map "length" bytes of the file at "offset" into memory, returns the view (NULL if failure)
+
+int32_t crud_msync(void *view);
+	// Write the bytes changed in the view back to the file
+
+int32_t crud_unmap_view(void *view);
+	// Write back the bytes changed in the view and release it
+
+//
+// File system global data
+
+extern int crud_file_compression; // New files are stored compressed (per mount switch)
+
 //
 // Unit testing for the module
 
@@ -20,6 +20,7 @@
 #define CRUD_NET_HEADER_SIZE sizeof(CrudResponse)
 #define CRUD_DEFAULT_IP "127.0.0.1"
 #define CRUD_DEFAULT_PORT 19876
+#define CRUD_MAX_PENDING_REQUESTS 64 // Requests that can be posted ahead of their responses
 
 //
 // Functional Prototypes
@@ -27,14 +28,34 @@
 CrudResponse crud_client_operation(CrudRequest op, void *buf);
     // This is the implementation of the client operation (crud_client.c)
 
+CrudResponse crud_client_range_operation(CrudRequest op, uint32_t offset, void *buf);
+    // This is the client operation for ranged requests (crud_client.c)
+
+int crud_client_post(CrudRequest op, uint32_t offset, void *buf);
+    // Send a request without waiting for its response, returns a ticket (crud_client.c)
+
+CrudResponse crud_client_complete(int ticket);
+    // Wait for the response to a posted request (crud_client.c)
+
+int crud_client_poll(int ticket);
+    // Check without blocking if the response to a posted request is in (crud_client.c)
+
 int crud_server( void );
     // This is the implementation of the server application (crud_server.c)
 
+int crud_test_server_connect( void );
+    // Start a connection to the in-process test server, returns the client end (crud_test_server.c)
+
+int crudTestServerUnitTest( void );
+    // Test the extension requests against the in-process test server (crud_test_server.c)
+
 //
 // Network Global Data
 
 extern int            crud_network_shutdown; // Flag indicating shutdown
 extern unsigned char *crud_network_address;  // Address of CRUD server 
 extern unsigned short crud_network_port;     // Port of CRUD server
+extern int            crud_network_extensions; // Server supports ranged requests
+extern int            crud_network_test_server; // Use the in-process test server instead
 
 #endif
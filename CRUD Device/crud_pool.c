@@ -0,0 +1,292 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_pool.c
+//  Description    : This is the implementation of the buffer pool of the
+//                   CRUD client.  Each buffer carries a small header giving
+//                   its size class; freed buffers go on a per-class free
+//                   list and are handed out again by the next allocation
+//                   of that class.  The interface functions are serialized
+//                   by a mutex.
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Project includes
+#include <crud_pool.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_POOL_NO_CLASS 0xffffffff // Oversized buffer, straight from the heap
+#define CRUD_POOL_MAX_FREE_BYTES (4*1024*1024) // Most free bytes kept per size class
+#define CRUD_POOL_UNIT_TEST_ITERATIONS 4096
+#define CRUD_POOL_UNIT_TEST_BUFFERS 32
+#define CRUD_POOL_UNIT_TEST_MAX_SIZE 200000
+
+// Type definitions
+
+// This is the header in front of each buffer (keeps the data 16 byte aligned)
+typedef union CrudPoolHeader {
+	struct {
+		uint32_t shift; // The size class (CRUD_POOL_NO_CLASS if oversized)
+		uint32_t size;  // The usable size of the buffer
+		union CrudPoolHeader *next; // The next free buffer of the class
+	} h;
+	char align[16];
+} CrudPoolHeader;
+
+//
+// Module local data
+
+static CrudPoolHeader *pool_free[CRUD_POOL_MAX_SHIFT+1];    // Free buffers by class
+static uint32_t        pool_free_count[CRUD_POOL_MAX_SHIFT+1]; // Length of each free list
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes the interface
+
+// Pool statistics
+static uint64_t pool_allocs = 0;
+static uint64_t pool_recycled = 0;
+static uint64_t pool_heap = 0;
+static uint64_t pool_released = 0;
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pool_class
+// Description  : Find the size class for a request
+//
+// Inputs       : size - the number of bytes needed
+// Outputs      : the class shift or CRUD_POOL_NO_CLASS if too big for any
+
+static uint32_t pool_class(uint32_t size) {
+
+	uint32_t shift = CRUD_POOL_MIN_SHIFT;
+	while ((shift <= CRUD_POOL_MAX_SHIFT) && ((1u << shift) < size)) {
+		shift++;
+	}
+	return((shift > CRUD_POOL_MAX_SHIFT) ? CRUD_POOL_NO_CLASS : shift);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pool_keep
+// Description  : Get the number of free buffers a class may hold on to
+//
+// Inputs       : shift - the size class
+// Outputs      : the limit on the free list length
+
+static uint32_t pool_keep(uint32_t shift) {
+
+	uint32_t keep = CRUD_POOL_MAX_FREE_BYTES >> shift;
+	if (keep > CRUD_POOL_MAX_FREE) {
+		keep = CRUD_POOL_MAX_FREE;
+	}
+	return((keep) ? keep : 1);
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : alloc_crud_pool
+// Description  : Get a buffer of at least the requested size, recycling a
+//                free one of the same class when there is one
+//
+// Inputs       : size - the number of bytes needed
+// Outputs      : pointer to the buffer or NULL if failure
+
+void * alloc_crud_pool(uint32_t size) {
+
+	CrudPoolHeader *hdr;
+	uint32_t shift = pool_class(size);
+	uint32_t bytes = (shift == CRUD_POOL_NO_CLASS) ? size : (1u << shift);
+
+	// Take a free buffer of the class if there is one
+	pthread_mutex_lock(&pool_lock);
+	pool_allocs++;
+	if ((shift != CRUD_POOL_NO_CLASS) && ((hdr = pool_free[shift]) != NULL)) {
+		pool_free[shift] = hdr->h.next;
+		pool_free_count[shift]--;
+		pool_recycled++;
+		pthread_mutex_unlock(&pool_lock);
+		return(hdr + 1);
+	}
+	pool_heap++;
+	pthread_mutex_unlock(&pool_lock);
+
+	// Otherwise go to the heap
+	if ((hdr = malloc(sizeof(CrudPoolHeader) + bytes)) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD pool : allocation of %u bytes failed", bytes);
+		return(NULL);
+	}
+	hdr->h.shift = shift;
+	hdr->h.size = bytes;
+	hdr->h.next = NULL;
+	return(hdr + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : free_crud_pool
+// Description  : Give a buffer back to the pool, it goes back to the heap
+//                if its class already holds enough free buffers
+//
+// Inputs       : buf - the buffer (from alloc_crud_pool, or NULL)
+// Outputs      : none
+
+void free_crud_pool(void *buf) {
+
+	CrudPoolHeader *hdr;
+	uint32_t shift;
+
+	// Nothing to free
+	if (buf == NULL) {
+		return;
+	}
+	hdr = (CrudPoolHeader *)buf - 1;
+	shift = hdr->h.shift;
+
+	// Keep it for the next allocation of the class if there is room
+	pthread_mutex_lock(&pool_lock);
+	if ((shift != CRUD_POOL_NO_CLASS) && (pool_free_count[shift] < pool_keep(shift))) {
+		hdr->h.next = pool_free[shift];
+		pool_free[shift] = hdr;
+		pool_free_count[shift]++;
+		pthread_mutex_unlock(&pool_lock);
+		return;
+	}
+	pool_released++;
+	pthread_mutex_unlock(&pool_lock);
+	free(hdr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : size_crud_pool
+// Description  : Get the usable size of a pool buffer (at least what was
+//                asked for, rounded up to the size class)
+//
+// Inputs       : buf - the buffer
+// Outputs      : the size in bytes
+
+uint32_t size_crud_pool(void *buf) {
+	return(((CrudPoolHeader *)buf - 1)->h.size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : close_crud_pool
+// Description  : Release the free buffers to the heap, log the statistics
+//                (buffers still in use stay valid and can be freed later)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int close_crud_pool(void) {
+
+	CrudPoolHeader *hdr;
+	uint32_t shift;
+
+	// Report the statistics for the session
+	pthread_mutex_lock(&pool_lock);
+	logMessage(LOG_OUTPUT_LEVEL, "CRUD pool : %lu allocations, %lu recycled, %lu from heap, %lu released (%.2f%% recycled)",
+			pool_allocs, pool_recycled, pool_heap, pool_released,
+			(pool_allocs) ? (double)pool_recycled*100.0/pool_allocs : 0.0);
+
+	// Empty the free lists
+	for (shift=CRUD_POOL_MIN_SHIFT; shift<=CRUD_POOL_MAX_SHIFT; shift++) {
+		while ((hdr = pool_free[shift]) != NULL) {
+			pool_free[shift] = hdr->h.next;
+			free(hdr);
+		}
+		pool_free_count[shift] = 0;
+	}
+	pool_allocs = pool_recycled = pool_heap = pool_released = 0;
+
+	// Return successfully
+	pthread_mutex_unlock(&pool_lock);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudPoolUnitTest
+// Description  : Perform a test of the pool implementation by allocating
+//                and freeing buffers of random sizes, checking that none
+//                of them overlap and that freed buffers get recycled
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crudPoolUnitTest(void) {
+
+	// Local variables
+	char *bufs[CRUD_POOL_UNIT_TEST_BUFFERS], *a, *b;
+	uint32_t sizes[CRUD_POOL_UNIT_TEST_BUFFERS], i, j, slot;
+
+	// Start from an empty pool
+	close_crud_pool();
+	memset(bufs, 0x0, sizeof(bufs));
+
+	for (i=0; i<CRUD_POOL_UNIT_TEST_ITERATIONS; i++) {
+
+		// Pick a buffer, check and free it if it is live
+		slot = getRandomValue(0, CRUD_POOL_UNIT_TEST_BUFFERS-1);
+		if (bufs[slot] != NULL) {
+			for (j=0; j<sizes[slot]; j++) {
+				if (bufs[slot][j] != (char)(slot+j)) {
+					logMessage(LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : buffer %u overwritten at %u.", slot, j);
+					return(-1);
+				}
+			}
+			free_crud_pool(bufs[slot]);
+			bufs[slot] = NULL;
+			continue;
+		}
+
+		// Otherwise allocate it at a random size and fill it
+		sizes[slot] = getRandomValue(1, CRUD_POOL_UNIT_TEST_MAX_SIZE);
+		if (((bufs[slot] = alloc_crud_pool(sizes[slot])) == NULL) || (size_crud_pool(bufs[slot]) < sizes[slot])) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : allocation of %u bytes failed.", sizes[slot]);
+			return(-1);
+		}
+		for (j=0; j<sizes[slot]; j++) {
+			bufs[slot][j] = (char)(slot+j);
+		}
+	}
+
+	// Free the rest, a freed buffer is the next one handed out for its class
+	for (slot=0; slot<CRUD_POOL_UNIT_TEST_BUFFERS; slot++) {
+		free_crud_pool(bufs[slot]);
+	}
+	close_crud_pool();
+	a = alloc_crud_pool(1000);
+	free_crud_pool(a);
+	b = alloc_crud_pool(600);
+	if ((a == NULL) || (a != b) || (pool_recycled == 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : buffer not recycled.");
+		return(-1);
+	}
+	free_crud_pool(b);
+
+	// Oversized buffers come from (and go back to) the heap
+	a = alloc_crud_pool((1u << CRUD_POOL_MAX_SHIFT) + 1);
+	if ((a == NULL) || (size_crud_pool(a) != (1u << CRUD_POOL_MAX_SHIFT) + 1)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : oversized allocation failed.");
+		return(-1);
+	}
+	a[(1u << CRUD_POOL_MAX_SHIFT)] = 1;
+	free_crud_pool(a);
+
+	// Cleanup
+	close_crud_pool();
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "CRUD pool unit test completed successfully.");
+	return(0);
+}
@@ -0,0 +1,41 @@
+#ifndef CRUD_POOL_INCLUDED
+#define CRUD_POOL_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_pool.h
+//  Description    : This is the interface for the buffer pool of the CRUD
+//                   client.  Buffers come in power of two size classes and
+//                   are recycled on free rather than returned to the heap.
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CRUD_POOL_MIN_SHIFT 8  // Smallest size class (256 bytes)
+#define CRUD_POOL_MAX_SHIFT 20 // Largest size class (1 MB, holds any object)
+#define CRUD_POOL_MAX_FREE 16  // Most free buffers kept per size class
+
+//
+// Pool interface
+
+void * alloc_crud_pool(uint32_t size);
+	// Get a buffer of at least size bytes (NULL if failure)
+
+void free_crud_pool(void *buf);
+	// Give a buffer back to the pool (NULL is ignored)
+
+uint32_t size_crud_pool(void *buf);
+	// Get the usable size of a pool buffer
+
+int close_crud_pool(void);
+	// Release the free buffers to the heap, log the statistics
+
+//
+// Unit testing for the module
+
+int crudPoolUnitTest(void);
+	// Perform a test of the pool implementation
+
+#endif
@@ -25,20 +25,28 @@
 #include <crud_driver.h>
 #include <crud_network.h>
 #include <crud_file_io.h>
+#include <crud_cache.h>
+#include <crud_pool.h>
+#include <crud_compress.h>
+#include <crud_crc.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 
 // Defines
 #define CRUD_SIM_MAX_OPEN_FILES 128
-#define CRUD_ARGUMENTS "hvul:x:a:p:"
+#define CRUD_ARGUMENTS "hvuezsl:c:x:a:p:"
 #define USAGE \
-	"USAGE: crud [-h] [-v] [-l <logfile>] [-c <sz>] [-x <file>] [-a <ip addr>] [-p <port>] <workload-file>\n" \
+	"USAGE: crud [-h] [-v] [-e] [-z] [-s] [-l <logfile>] [-c <sz>] [-x <file>] [-a <ip addr>] [-p <port>] <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
 	"    -u - run the unit tests instead of the simulator\n" \
 	"    -v - verbose output\n" \
+	"    -e - server supports the ranged request extensions (see crud_driver.h)\n" \
+	"    -z - store the files created compressed\n" \
+	"    -s - use an in-process test server (supports the extensions, objects last until exit)\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
+	"    -c - size of the object cache (in cache lines, one object per line)\n" \
 	"    -x - extract a file <file> from the crud filesystem\n" \
 	"    -a - IP address of server to connect to.\n" \
 	"    -p - port number of server to connect to.\n" \
@@ -76,8 +84,8 @@ int extract_file_from_crud(char *ex_file);
 
 int main( int argc, char *argv[] ) {
 	// Local variables
-	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, extract_file = 0;
-	uint32_t cache_size = 1024; // Defaults to 1024 cache lines
+	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, extract_file = 0, failed;
+	uint32_t cache_size = CRUD_DEFAULT_CACHE_LINES; // Defaults to 1024 cache lines
 	char *ex_file = NULL;
 
 	// Process the command line parameters
@@ -96,6 +104,18 @@ int main( int argc, char *argv[] ) {
 			unit_tests = 1;
 			break;
 
+		case 'e': // Protocol extensions flag
+			crud_network_extensions = 1;
+			break;
+
+		case 'z': // Compress new files flag
+			crud_file_compression = 1;
+			break;
+
+		case 's': // In-process test server flag
+			crud_network_test_server = 1;
+			break;
+
 		case 'l': // Set the log filename
 			initializeLogWithFilename( optarg );
 			log_initialized = 1;
@@ -142,12 +162,25 @@ int main( int argc, char *argv[] ) {
 		enableLogLevels( LOG_INFO_LEVEL );
 	}
 
+	// Size the object cache used by the file layer
+	if ( set_crud_cache_size(cache_size) ) {
+		logMessage( LOG_ERROR_LEVEL, "Bad  cache size [%u]", cache_size );
+		return( -1 );
+	}
+
 	// If we are running the unit tests, do that
 	if ( unit_tests ) {
 
-		// Enable verbose, run the tests and check the results
+		// Enable verbose, run the tests and check the results; against the
+		// test server the IO test runs both without and with the extensions
 		enableLogLevels( LOG_INFO_LEVEL );
-		if ( b64UnitTest() || crudIOUnitTest() ) {
+		failed = b64UnitTest() || crudPoolUnitTest() || crudCompressUnitTest() || crudCrcUnitTest() || crudCacheUnitTest() ||
+				(crud_network_test_server && crudTestServerUnitTest()) || crudIOUnitTest();
+		if ( !failed && crud_network_test_server && !crud_network_extensions ) {
+			crud_network_extensions = 1;
+			failed = crudIOUnitTest();
+		}
+		if ( failed ) {
 			logMessage( LOG_ERROR_LEVEL, "CRUD unit tests failed.\n\n" );
 		} else {
 			logMessage( LOG_INFO_LEVEL, "CRUD unit tests completed successfully.\n\n" );
@@ -291,6 +324,18 @@ int simulate_CRUD( char *wload ) {
 				}
 
 
+			} else if (strncmp(command, "SYNC", 4) == 0) {
+
+				// Log the command executed
+				logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Syncing CRUD filesystem");
+
+				// Now write back the changed file table
+				if (crud_sync() != len) {
+					// Failed, error out
+					logMessage(LOG_ERROR_LEVEL, "Sync failed, aborting simulation.");
+					return(-1);
+				}
+
 			} else {
 
 				//
@@ -400,13 +445,13 @@ int simulate_CRUD( char *wload ) {
 					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Reading %d bytes from file [%s]", len, fname);
 
 					// Now perform the read
-					rbuf = malloc(len);
+					rbuf = alloc_crud_pool(len);
 					if (crud_read(ftable[idx].fhandle, rbuf, len) != len) {
 						// Failed, error out
 						logMessage(LOG_ERROR_LEVEL, "Read file [%s] of length %d failed, aborting simulation.", fname, off);
 						return(-1);
 					}
-					free(rbuf);
+					free_crud_pool(rbuf);
 					rbuf = NULL;
 
 				} else {
@@ -447,10 +492,9 @@ int extract_file_from_crud(char *ex_file) {
 	char buf[CRUD_MAX_OBJECT_SIZE];
     int fhandle, flags;
     mode_t mode;
-	// Open the file, read from it, close it
+	// Open the file, read the first block from it
 	if ( (crud_mount()) || ((fd = crud_open(ex_file)) == -1) ||
-		 ((len = crud_read(fd, buf, CRUD_MAX_OBJECT_SIZE)) == -1) ||
-		 (crud_close(fd) == -1)	) {
+		 ((len = crud_read(fd, buf, CRUD_MAX_OBJECT_SIZE)) == -1) ) {
 		// Error out
 		logMessage(LOG_INFO_LEVEL, "CRUD : extraction failed on crud interface [%s].", ex_file);
 		return(-1);
@@ -465,12 +509,23 @@ int extract_file_from_crud(char *ex_file) {
         return( -1 );
     }
 
-    // Now write the read bytes to the file, then close
-    if (write(fhandle, buf, len) != len) {
-        fprintf( stderr, "CRUD: extraction write() failed, error=%s\n", strerror(errno) );
-        return( -1 );
+    // Now write the read bytes to the file, a block at a time (files can
+    // be larger than a single object), then close
+    while (len > 0) {
+        if (write(fhandle, buf, len) != len) {
+            fprintf( stderr, "CRUD: extraction write() failed, error=%s\n", strerror(errno) );
+            return( -1 );
+        }
+        if ((len = crud_read(fd, buf, CRUD_MAX_OBJECT_SIZE)) == -1) {
+            logMessage(LOG_INFO_LEVEL, "CRUD : extraction failed on crud interface [%s].", ex_file);
+            return( -1 );
+        }
     }
     close( fhandle );
+    if (crud_close(fd) == -1) {
+        logMessage(LOG_INFO_LEVEL, "CRUD : extraction failed on crud interface [%s].", ex_file);
+        return( -1 );
+    }
 
     // Return successfully
 	return( 0 );
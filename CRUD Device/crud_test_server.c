@@ -0,0 +1,517 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_test_server.c
+//  Description    : This is an in-process CRUD server for testing the client.
+//                   It keeps the objects in memory and serves one connection
+//                   at a time on a thread, over a socket pair, speaking the
+//                   same protocol as the CRUD server including the ranged,
+//                   append, truncate and copy extensions (see crud_driver.h).
+//                   The objects last until the program exits.
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+// Project includes
+#include <crud_driver.h>
+#include <crud_network.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_TEST_SERVER_BUFFER (4*1024*1024) // Socket buffer size of each end of the connection
+#define CRUD_TEST_SERVER_UNIT_TEST_SIZE 5000
+
+// Type definitions
+
+// This is an object of the store
+typedef struct {
+	char     *data;   // The contents of the object
+	uint32_t  length; // The size of the object
+	uint8_t   flags;  // The flags given when it was created or last updated
+	uint8_t   used;   // Flag indicating the object exists
+} CrudTestObject;
+
+//
+// Module local data
+
+static CrudTestObject *test_objects = NULL;   // The objects by OID (0 is the priority object)
+static uint32_t        test_object_count = 1; // Next OID to hand out
+static uint32_t        test_object_room = 0;  // Number of objects allocated
+static pthread_mutex_t test_store_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes the store
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_receive
+// Description  : Read exactly count bytes from the connection
+//
+// Inputs       : fd - the server end of the connection
+//                buf - where to put the bytes
+//                count - the number of bytes
+// Outputs      : 0 if successful, -1 if the connection is gone
+
+static int test_receive(int fd, void *buf, uint32_t count) {
+
+	ssize_t got;
+	uint32_t done = 0;
+	while (done < count) {
+		if ((got = read(fd, (char *)buf + done, count - done)) <= 0) {
+			return(-1);
+		}
+		done += got;
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_send
+// Description  : Write exactly count bytes to the connection
+//
+// Inputs       : fd - the server end of the connection
+//                buf - the bytes
+//                count - the number of bytes
+// Outputs      : 0 if successful, -1 if the connection is gone
+
+static int test_send(int fd, const void *buf, uint32_t count) {
+
+	ssize_t put;
+	uint32_t done = 0;
+	while (done < count) {
+		if ((put = write(fd, (const char *)buf + done, count - done)) <= 0) {
+			return(-1);
+		}
+		done += put;
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_object
+// Description  : Find the object a request is about
+//
+// Inputs       : oid - the object ID of the request
+//                flags - the flags of the request
+// Outputs      : the object, NULL if there is no such object
+
+static CrudTestObject *test_object(CrudOID oid, uint8_t flags) {
+
+	if (flags & CRUD_PRIORITY_OBJECT) {
+		oid = 0;
+	}
+	if ((oid >= test_object_room) || !test_objects[oid].used) {
+		return(NULL);
+	}
+	return(&test_objects[oid]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_new_object
+// Description  : Make a new object holding a copy of some bytes
+//
+// Inputs       : priority - flag indicating it is the priority object
+//                data - the contents
+//                length - the size
+//                flags - the flags stored with it
+// Outputs      : the OID of the object, -1 if failure
+
+static int64_t test_new_object(int priority, const char *data, uint32_t length, uint8_t flags) {
+
+	CrudTestObject *grown, *obj;
+	uint32_t room, oid = (priority) ? 0 : test_object_count;
+
+	// Make room for the new OID (the priority object has its own)
+	if (oid + 1 > test_object_room) {
+		room = (test_object_room) ? 2 * test_object_room : 1024;
+		if ((grown = realloc(test_objects, room * sizeof(CrudTestObject))) == NULL) {
+			return(-1);
+		}
+		memset(&grown[test_object_room], 0, (room - test_object_room) * sizeof(CrudTestObject));
+		test_objects = grown;
+		test_object_room = room;
+	}
+
+	// Fill it in, an existing priority object is replaced
+	obj = &test_objects[oid];
+	free(obj->data);
+	if ((obj->data = malloc((length) ? length : 1)) == NULL) {
+		obj->used = 0;
+		return(-1);
+	}
+	memcpy(obj->data, data, length);
+	obj->length = length;
+	obj->flags = flags;
+	obj->used = 1;
+	if (!priority) {
+		test_object_count++;
+	}
+	return(oid);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_resize_object
+// Description  : Change the size of an object, zero filling any new bytes
+//
+// Inputs       : obj - the object
+//                length - the new size
+// Outputs      : 0 if successful, -1 if failure
+
+static int test_resize_object(CrudTestObject *obj, uint32_t length) {
+
+	char *grown;
+	if (length > CRUD_MAX_OBJECT_SIZE) {
+		return(-1);
+	}
+	if ((grown = realloc(obj->data, (length) ? length : 1)) == NULL) {
+		return(-1);
+	}
+	if (length > obj->length) {
+		memset(&grown[obj->length], 0, length - obj->length);
+	}
+	obj->data = grown;
+	obj->length = length;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_format
+// Description  : Drop every object of the store
+//
+// Inputs       : none
+// Outputs      : none
+
+static void test_format(void) {
+
+	uint32_t i;
+	for (i=0; i<test_object_room; i++) {
+		free(test_objects[i].data);
+	}
+	free(test_objects);
+	test_objects = NULL;
+	test_object_room = 0;
+	test_object_count = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_serve_request
+// Description  : Carry out a request on the store
+//
+// Inputs       : request - the request received
+//                offset - the offset of the range word (ranged requests)
+//                payload - the bytes following the request (if any)
+//                reply - place to put the bytes to send back (reads)
+//                replyLength - place to put the number of bytes to send back
+// Outputs      : the response
+
+static CrudResponse test_serve_request(CrudRequest request, uint32_t offset, char *payload, char **reply, uint32_t *replyLength) {
+
+	CrudOID oid, roid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length, rlength;
+	uint8_t flags, rflags, res;
+	CrudTestObject *obj;
+	int64_t made;
+
+	// The response echoes the request unless the request says otherwise
+	deconstruct_crud_request(request, &oid, &req, &length, &flags, &res);
+	roid = oid;
+	rlength = length;
+	rflags = flags;
+	res = 0;
+	*reply = NULL;
+	*replyLength = 0;
+	obj = test_object(oid, flags);
+
+	switch (req) {
+	case CRUD_INIT:
+	case CRUD_CLOSE:
+		break;
+
+	case CRUD_FORMAT:
+		test_format();
+		break;
+
+	case CRUD_CREATE: // New object, the priority object is always OID 0
+		if ((made = test_new_object(flags & CRUD_PRIORITY_OBJECT, payload, length, flags)) == -1) {
+			res = 1;
+		} else {
+			roid = (CrudOID)made;
+		}
+		break;
+
+	case CRUD_READ: // The buffer must be able to hold the whole object
+		if ((obj == NULL) || (length < obj->length)) {
+			res = 1;
+		} else {
+			*reply = obj->data;
+			*replyLength = rlength = obj->length;
+			rflags = obj->flags;
+		}
+		break;
+
+	case CRUD_UPDATE: // The size cannot change
+		if ((obj == NULL) || (length != obj->length)) {
+			res = 1;
+		} else {
+			memcpy(obj->data, payload, length);
+			obj->flags = flags | (obj->flags & CRUD_PRIORITY_OBJECT);
+		}
+		break;
+
+	case CRUD_DELETE:
+		if (obj == NULL) {
+			res = 1;
+		} else {
+			free(obj->data);
+			memset(obj, 0, sizeof(CrudTestObject));
+		}
+		break;
+
+	case CRUD_READ_RANGE: // Clipped at the end of the object
+		if ((obj == NULL) || (offset > obj->length)) {
+			res = 1;
+		} else {
+			*reply = &obj->data[offset];
+			*replyLength = rlength = (length < obj->length - offset) ? length : obj->length - offset;
+			rflags = obj->flags;
+		}
+		break;
+
+	case CRUD_UPDATE_RANGE: // The range must lie inside the object
+		if ((obj == NULL) || (offset > obj->length) || (length > obj->length - offset)) {
+			res = 1;
+		} else {
+			memcpy(&obj->data[offset], payload, length);
+		}
+		break;
+
+	case CRUD_APPEND:
+		if ((obj == NULL) || (test_resize_object(obj, obj->length + length) != 0)) {
+			res = 1;
+		} else {
+			memcpy(&obj->data[obj->length - length], payload, length);
+		}
+		break;
+
+	case CRUD_TRUNCATE:
+		if ((obj == NULL) || (test_resize_object(obj, length) != 0)) {
+			res = 1;
+		}
+		break;
+
+	case CRUD_COPY: // The copy is a new object with the contents and flags
+		if ((obj == NULL) || ((made = test_new_object(0, obj->data, obj->length, obj->flags)) == -1)) {
+			res = 1;
+		} else {
+			roid = (CrudOID)made;
+			rlength = test_objects[roid].length;
+			rflags = test_objects[roid].flags;
+		}
+		break;
+
+	default:
+		logMessage(LOG_ERROR_LEVEL, "CRUD test server : unknown request type [%d].", req);
+		res = 1;
+		break;
+	}
+
+	// A failed read returns no bytes
+	if (res && ((req == CRUD_READ) || (req == CRUD_READ_RANGE))) {
+		rlength = 0;
+	}
+	return(construct_crud_request(roid, req, rlength, rflags, res));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_serve
+// Description  : Serve the requests on a connection until it is closed
+//
+// Inputs       : arg - the server end of the connection (an int cast to a pointer)
+// Outputs      : NULL
+
+static void *test_serve(void *arg) {
+
+	int fd = (int)(intptr_t)arg;
+	CrudRequest request, response;
+	CrudRange range;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length, offset, replyLength;
+	char *payload = NULL, *reply;
+	int ok = 1;
+
+	// Take each request with its range word and bytes, send the response
+	while (ok && (test_receive(fd, &request, sizeof(request)) == 0)) {
+		request = ntohll64(request);
+		req = (request >> 28) & 0xf;
+		length = (request >> 4) & 0xffffff;
+		offset = 0;
+		if (crud_request_is_ranged(req) && ((test_receive(fd, &range, sizeof(range)) != 0) ||
+				(deconstruct_crud_range(ntohll64(range), &offset) != 0))) {
+			break;
+		}
+		if ((req == CRUD_CREATE) || (req == CRUD_UPDATE) || (req == CRUD_UPDATE_RANGE) || (req == CRUD_APPEND)) {
+			if (((payload = malloc((length) ? length : 1)) == NULL) || (test_receive(fd, payload, length) != 0)) {
+				break;
+			}
+		}
+
+		pthread_mutex_lock(&test_store_lock);
+		response = test_serve_request(request, offset, payload, &reply, &replyLength);
+		response = htonll64(response);
+		ok = (test_send(fd, &response, sizeof(response)) == 0) && (test_send(fd, reply, replyLength) == 0);
+		pthread_mutex_unlock(&test_store_lock);
+		free(payload);
+		payload = NULL;
+
+		if (req == CRUD_CLOSE) {
+			break;
+		}
+	}
+
+	free(payload);
+	close(fd);
+	return(NULL);
+}
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_test_server_connect
+// Description  : Start a connection to the in-process test server, served
+//                by a thread of its own until the client closes it
+//
+// Inputs       : none
+// Outputs      : the client end of the connection, -1 if failure
+
+int crud_test_server_connect(void) {
+
+	int ends[2], size = CRUD_TEST_SERVER_BUFFER, i;
+	pthread_t server;
+
+	// Big socket buffers, so posted reads do not stall the server as soon
+	// as the client stops to send something
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD test server : socket pair creation failed.");
+		return(-1);
+	}
+	for (i=0; i<2; i++) {
+		setsockopt(ends[i], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+		setsockopt(ends[i], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	}
+	if (pthread_create(&server, NULL, test_serve, (void *)(intptr_t)ends[1]) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD test server : thread creation failed.");
+		close(ends[0]);
+		close(ends[1]);
+		return(-1);
+	}
+	pthread_detach(server);
+	return(ends[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_request
+// Description  : Send a request through the client, for the unit test
+//
+// Inputs       : oid, req, length - the request
+//                offset - the range offset (ranged requests)
+//                buf - the bytes to send or the place for the bytes read
+//                roid - place to put the OID of the response
+//                rlength - place to put the length of the response
+// Outputs      : the result bit of the response
+
+static int test_request(CrudOID oid, CRUD_REQUEST_TYPES req, uint32_t length, uint32_t offset, void *buf,
+		CrudOID *roid, uint32_t *rlength) {
+
+	CRUD_REQUEST_TYPES rreq;
+	uint8_t flags, res;
+	deconstruct_crud_request(crud_client_range_operation(construct_crud_request(oid, req, length, 0, 0), offset, buf),
+			roid, &rreq, rlength, &flags, &res);
+	return(res);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudTestServerUnitTest
+// Description  : Perform a test of the extension requests against the test
+//                server, through the client (which must be using it)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crudTestServerUnitTest(void) {
+
+	// Local variables
+	static char data[CRUD_TEST_SERVER_UNIT_TEST_SIZE], buf[2*CRUD_TEST_SERVER_UNIT_TEST_SIZE], zeros[200];
+	CrudOID oid, copy, roid;
+	uint32_t length, i;
+
+	// Connect, start from an empty store with one object
+	for (i=0; i<CRUD_TEST_SERVER_UNIT_TEST_SIZE; i++) {
+		data[i] = (char)getRandomValue(0, 255);
+	}
+	if (test_request(0, CRUD_INIT, 0, 0, NULL, &roid, &length) || test_request(0, CRUD_FORMAT, 0, 0, NULL, &roid, &length) ||
+			test_request(0, CRUD_CREATE, CRUD_TEST_SERVER_UNIT_TEST_SIZE, 0, data, &oid, &length) || (oid == CRUD_NO_OBJECT)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_TEST_SERVER_UNIT_TEST : connection or create failed.");
+		return(-1);
+	}
+
+	// A ranged read is clipped at the end of the object, one past it fails
+	if (test_request(oid, CRUD_READ_RANGE, 1000, CRUD_TEST_SERVER_UNIT_TEST_SIZE-300, buf, &roid, &length) || (length != 300) ||
+			memcmp(buf, &data[CRUD_TEST_SERVER_UNIT_TEST_SIZE-300], 300) ||
+			!test_request(oid, CRUD_READ_RANGE, 10, CRUD_TEST_SERVER_UNIT_TEST_SIZE+1, buf, &roid, &length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_TEST_SERVER_UNIT_TEST : ranged read failed.");
+		return(-1);
+	}
+
+	// A ranged update must lie inside the object
+	memset(&data[10], 0x5a, 100);
+	if (test_request(oid, CRUD_UPDATE_RANGE, 100, 10, &data[10], &roid, &length) ||
+			!test_request(oid, CRUD_UPDATE_RANGE, 100, CRUD_TEST_SERVER_UNIT_TEST_SIZE-50, data, &roid, &length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_TEST_SERVER_UNIT_TEST : ranged update failed.");
+		return(-1);
+	}
+
+	// Append grows the object, truncate cuts it and zero fills it out again
+	if (test_request(oid, CRUD_APPEND, 200, 0, data, &roid, &length) ||
+			test_request(oid, CRUD_TRUNCATE, CRUD_TEST_SERVER_UNIT_TEST_SIZE+100, 0, NULL, &roid, &length) ||
+			(length != CRUD_TEST_SERVER_UNIT_TEST_SIZE+100) ||
+			test_request(oid, CRUD_TRUNCATE, CRUD_TEST_SERVER_UNIT_TEST_SIZE+300, 0, NULL, &roid, &length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_TEST_SERVER_UNIT_TEST : append or truncate failed.");
+		return(-1);
+	}
+
+	// The copy is a new object with the same contents, a whole read needs room for all of it
+	if (test_request(oid, CRUD_COPY, 0, 0, NULL, &copy, &length) || (copy == oid) || (length != CRUD_TEST_SERVER_UNIT_TEST_SIZE+300) ||
+			!test_request(copy, CRUD_READ, CRUD_TEST_SERVER_UNIT_TEST_SIZE, 0, buf, &roid, &length) ||
+			test_request(copy, CRUD_READ, 2*CRUD_TEST_SERVER_UNIT_TEST_SIZE, 0, buf, &roid, &length) ||
+			(length != CRUD_TEST_SERVER_UNIT_TEST_SIZE+300) || memcmp(buf, data, CRUD_TEST_SERVER_UNIT_TEST_SIZE) ||
+			memcmp(&buf[CRUD_TEST_SERVER_UNIT_TEST_SIZE], data, 100) ||
+			memcmp(&buf[CRUD_TEST_SERVER_UNIT_TEST_SIZE+100], zeros, 200)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_TEST_SERVER_UNIT_TEST : copy failed.");
+		return(-1);
+	}
+
+	// Close the connection, return successfully
+	if (test_request(0, CRUD_CLOSE, 0, 0, NULL, &roid, &length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_TEST_SERVER_UNIT_TEST : close failed.");
+		return(-1);
+	}
+	logMessage(LOG_INFO_LEVEL, "CRUD test server unit test completed successfully.");
+	return(0);
+}
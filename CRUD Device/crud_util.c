@@ -34,7 +34,7 @@ CrudRequest construct_crud_request(CrudOID oid, CRUD_REQUEST_TYPES req,
 	// Build up the request fields
 	CrudRequest request = 0;
 	request = ((uint64_t) oid) << 32;
-	request |= req << 28;
+	request |= ((uint64_t) req) << 28;
 	request |= length << 4;
 	request |= flags << 1;
 	request |= res;
@@ -72,3 +72,54 @@ int deconstruct_crud_request(CrudRequest request, CrudOID *oid,
 	// Return successfully
 	return (0);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_request_is_ranged
+// Description  : Does the request type carry a range extension word?
+//
+// Inputs       : req - the request type
+// Outputs      : 1 if ranged, 0 otherwise
+
+int crud_request_is_ranged(CRUD_REQUEST_TYPES req) {
+	return ((req == CRUD_READ_RANGE) || (req == CRUD_UPDATE_RANGE));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : construct_crud_range
+// Description  : Construct the range extension word (see crud_driver.h)
+//
+// Inputs       : offset - the byte offset into the object
+// Outputs      : the range extension word
+
+CrudRange construct_crud_range(uint32_t offset) {
+
+	// Build up the range fields
+	CrudRange range = 0;
+	range = (uint64_t) offset;
+
+	// Return successfully
+	return (range);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : deconstruct_crud_range
+// Description  : Extract the fields from the range extension word
+//
+// Inputs       : range - the range extension word (see crud_driver.h)
+//                offset - the place to put the byte offset
+// Outputs      : 0 if successful, -1 if failure
+
+int deconstruct_crud_range(CrudRange range, uint32_t *offset) {
+
+	// Pull out the fields, reserved bits must be clear
+	*offset = range & 0xffffffff;
+	if (range >> 32) {
+		return (-1);
+	}
+
+	// Return successfully
+	return (0);
+}